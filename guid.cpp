@@ -6,6 +6,10 @@
 #include <cstring>
 #include <cassert>
 #include <cwchar>
+#include <cctype>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
 #include "WonCLSIDFromString.h"
 #include "WonStringFromGUID2.h"
 
@@ -37,23 +41,6 @@ mstr_replace_all(T_STR& str,
     return mstr_replace_all(str, T_STR(from), T_STR(to));
 }
 
-template <typename T_STR_CONTAINER>
-static inline void
-mstr_split(T_STR_CONTAINER& container,
-    const typename T_STR_CONTAINER::value_type& str,
-    const typename T_STR_CONTAINER::value_type& chars)
-{
-    container.clear();
-    size_t i = 0, k = str.find_first_of(chars);
-    while (k != T_STR_CONTAINER::value_type::npos)
-    {
-        container.push_back(str.substr(i, k - i));
-        i = k + 1;
-        k = str.find_first_of(chars, i);
-    }
-    container.push_back(str.substr(i));
-}
-
 template <typename T_STR>
 static inline void
 mstr_trim(T_STR& str, const typename T_STR::value_type* spaces)
@@ -76,152 +63,281 @@ bool guid_equal(const GUID& guid1, const GUID& guid2)
 #endif
 }
 
-bool guid_is_valid_value(const wchar_t *text)
+static inline void guid_upper_ascii(std::string& str)
+{
+    for (auto& ch : str)
+    {
+        if ('a' <= ch && ch <= 'z')
+            ch += 'A' - 'a';
+    }
+}
+
+bool guid_is_valid_value(const char *text)
 {
-    std::wstring str = text;
-    mstr_trim(str, L" \t\r\n");
-    wchar_t *endptr;
-    wcstoul(str.c_str(), &endptr, 0);
+    std::string str = text;
+    mstr_trim(str, " \t\r\n");
+    char *endptr;
+    strtoul(str.c_str(), &endptr, 0);
     return (*endptr == 0 || (endptr[0] == 'L' && endptr[1] == 0));
 }
 
-void guid_remove_comments(std::wstring& str)
+bool guid_is_valid_value(const wchar_t *text)
 {
-    // Remove C comments
-    size_t ich0 = 0, ich1;
-    for (;;)
+    return guid_is_valid_value(guid_ansi_from_wide(text, CP_UTF8).c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Tokenizing C text without allocation
+
+static inline bool guid_is_space(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+// Skips spaces and comments. An unterminated comment is not skipped
+static const char *guid_skip_space_slow(const char *pch, const char *end)
+{
+    while (pch < end)
     {
-        ich0 = str.find(L"/*", ich0);
-        if (ich0 == str.npos)
+        if (guid_is_space(*pch))
+        {
+            ++pch;
+        }
+        else if (*pch == '/' && pch + 1 < end && pch[1] == '*')
+        {
+            const char *pch2 = pch + 2;
+            while (pch2 + 1 < end && !(pch2[0] == '*' && pch2[1] == '/'))
+                ++pch2;
+            if (pch2 + 1 >= end)
+                break;
+            pch = pch2 + 2;
+        }
+        else if (*pch == '/' && pch + 1 < end && pch[1] == '/')
+        {
+            const char *pch2 = (const char *)memchr(pch, '\n', end - pch);
+            pch = pch2 ? pch2 : end;
+        }
+        else
+        {
             break;
+        }
+    }
+    return pch;
+}
 
-        ich1 = str.find(L"*/", ich0);
-        if (ich1 == str.npos)
-            break;
+static inline const char *guid_skip_space(const char *pch, const char *end)
+{
+    // Mostly none or a space
+    if (pch < end && *pch == ' ')
+        ++pch;
+    if (pch < end && !guid_is_space(*pch) && *pch != '/')
+        return pch;
+    return guid_skip_space_slow(pch, end);
+}
+
+// Skips spaces and comments and then the character ch. Returns NULL if ch is not there
+static inline const char *guid_expect(const char *pch, const char *end, char ch)
+{
+    pch = guid_skip_space(pch, end);
+    return (pch < end && *pch == ch) ? pch + 1 : NULL;
+}
 
-        str.erase(ich0, ich1 + 2 - ich0);
+// Skips an identifier or a string literal
+static const char *guid_skip_item(const char *pch, const char *end)
+{
+    if (pch < end && *pch == '"')
+    {
+        const char *pch2 = (const char *)memchr(pch + 1, '"', end - pch - 1);
+        return pch2 ? pch2 + 1 : end;
     }
 
-    // Remove C++ comments
-    ich0 = 0;
-    for (;;)
+    for (; pch < end; ++pch)
     {
-        ich0 = str.find(L"//", ich0);
-        if (ich0 == str.npos)
+        char ch = *pch;
+        if (guid_is_space(ch) || ch == ',' || ch == '(' || ch == ')' || ch == ';' || ch == '/' ||
+            ch == '"')
+        {
             break;
+        }
+    }
+    return pch;
+}
 
-        ich1 = str.find(L"\n", ich0);
-        if (ich1 == str.npos)
-            str.erase(ich0, str.size() - ich0);
-        else
-            str.erase(ich0, ich1 - ich0);
+static inline int guid_digit_value(char ch)
+{
+    if ('0' <= ch && ch <= '9')
+        return ch - '0';
+    ch |= 0x20;
+    if ('a' <= ch && ch <= 'f')
+        return ch - 'a' + 10;
+    return 16;
+}
+
+// Reads an integer literal such as 0x1A2B, 0777, 123 or 0x12345678L.
+// Returns the end of it, or NULL if none
+static const char *guid_read_number(const char *pch, const char *end, uint32_t& value)
+{
+    int base = 10;
+    if (pch < end && *pch == '0')
+    {
+        base = 8;
+        if (pch + 2 < end && (pch[1] | 0x20) == 'x' && guid_digit_value(pch[2]) < 16)
+        {
+            base = 16;
+            pch += 2;
+        }
     }
+
+    const char *start = pch;
+    int digit;
+    value = 0;
+    while (pch < end && (digit = guid_digit_value(*pch)) < base)
+    {
+        value = value * base + digit;
+        ++pch;
+    }
+    if (pch == start)
+        return NULL;
+
+    while (pch < end && (*pch == 'u' || *pch == 'U' || *pch == 'l' || *pch == 'L'))
+        ++pch;
+    return pch;
 }
 
-bool guid_from_definition(GUID& guid, const wchar_t *text, std::wstring *p_name)
+static inline bool guid_has_prefix(const char *pch, const char *end, const char *prefix, size_t len)
+{
+    return (size_t)(end - pch) >= len && memcmp(pch, prefix, len) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool guid_parse_definition(GUID& guid, const char *text, size_t cch,
+                           const char **p_name, size_t *p_name_len)
 {
-    std::wstring str = text;
-    mstr_trim(str, L" \t\r\n");
-    guid_remove_comments(str);
-    mstr_trim(str, L" \t\r\n");
+    const char *pch = guid_skip_space(text, text + cch), *end = text + cch;
 
+    // DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
+    // EXTERN_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
+    // DEFINE_CODECAPI_GUID(name, "text", l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
+    // MIDL_DEFINE_GUID(type, name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
+    // DEFINE_OLEGUID(name, l, w1, w2)
     bool codecapi = false, midl = false, oleguid = false;
-    if (str.find(L"DEFINE_GUID") == 0 || str.find(L"EXTERN_GUID") == 0)
+    if (guid_has_prefix(pch, end, "DEFINE_GUID", 11) || guid_has_prefix(pch, end, "EXTERN_GUID", 11))
     {
-        str.erase(0, 11);
+        pch += 11;
     }
-    else if (str.find(L"DEFINE_CODECAPI_GUID") == 0)
+    else if (guid_has_prefix(pch, end, "DEFINE_CODECAPI_GUID", 20))
     {
-        str.erase(0, 20);
+        pch += 20;
         codecapi = true;
     }
-    else if (str.find(L"MIDL_DEFINE_GUID") == 0)
+    else if (guid_has_prefix(pch, end, "MIDL_DEFINE_GUID", 16))
     {
-        str.erase(0, 16);
+        pch += 16;
         midl = true;
     }
-    else if (str.find(L"DEFINE_OLEGUID") == 0)
+    else if (guid_has_prefix(pch, end, "DEFINE_OLEGUID", 14))
     {
-        str.erase(0, 14);
+        pch += 14;
         oleguid = true;
     }
-
     else
     {
         return false;
     }
 
-    mstr_trim(str, L" \t\r\n");
-
-    if (str.size() && str[0] == L'(')
-        str.erase(0, 1);
-    else
-        return false;
-
-    mstr_trim(str, L" \t\r\n");
-
-    if (str.size() && str[str.size() - 1] == L';')
-        str.erase(str.size() - 1, 1);
-
-    mstr_trim(str, L" \t\r\n");
-
-    if (str.size() && str[str.size() - 1] == L')')
-        str.erase(str.size() - 1, 1);
-    else
+    pch = guid_expect(pch, end, '(');
+    if (!pch)
         return false;
 
-    mstr_trim(str, L" \t\r\n");
-    mstr_replace_all(str, L" ", L"");
-    mstr_replace_all(str, L"\t", L"");
+    if (midl)
+    {
+        pch = guid_expect(guid_skip_item(guid_skip_space(pch, end), end), end, ',');
+        if (!pch)
+            return false;
+    }
 
-    std::vector<std::wstring> items;
-    mstr_split(items, str, L",");
+    const char *name = guid_skip_space(pch, end);
+    pch = guid_skip_item(name, end);
+    const char *name_end = pch;
 
     if (codecapi)
-        items.erase(items.begin() + 1);
-
-    if (midl)
-        items.erase(items.begin());
+    {
+        pch = guid_expect(pch, end, ',');
+        if (!pch)
+            return false;
+        pch = guid_skip_item(guid_skip_space(pch, end), end);
+    }
 
-    if (oleguid && items.size() == 4)
+    uint32_t values[11];
+    int count = (oleguid ? 3 : 11);
+    for (int i = 0; i < count; ++i)
     {
-        std::vector<std::wstring> new_items =
-        {
-            items[0], items[1], items[2], items[3], L"0xC0",
-            L"0", L"0", L"0", L"0", L"0", L"0", L"0x46"
-        };
-        items = std::move(new_items);
+        pch = guid_expect(pch, end, ',');
+        if (!pch)
+            return false;
+        pch = guid_read_number(guid_skip_space(pch, end), end, values[i]);
+        if (!pch)
+            return false;
     }
 
-    if (items.size() != 12)
+    pch = guid_expect(pch, end, ')');
+    if (!pch)
+        return false;
+    pch = guid_skip_space(pch, end);
+    if (pch < end && *pch == ';')
+        pch = guid_skip_space(pch + 1, end);
+    if (pch != end)
         return false;
 
-    for (auto& item : items)
+    guid.Data1 = values[0];
+    guid.Data2 = (uint16_t)values[1];
+    guid.Data3 = (uint16_t)values[2];
+    if (oleguid)
     {
-        mstr_trim(item, L" \t");
+        static const uint8_t s_ole_data4[8] = { 0xC0, 0, 0, 0, 0, 0, 0, 0x46 };
+        memcpy(guid.Data4, s_ole_data4, sizeof(s_ole_data4));
     }
-
-    for (int i = 1; i <= 11; ++i)
+    else
     {
-        if (!guid_is_valid_value(items[i].c_str()))
-            return false;
+        for (int i = 0; i < 8; ++i)
+            guid.Data4[i] = (uint8_t)values[3 + i];
     }
 
-    guid.Data1 = (uint32_t)wcstoul(items[1].c_str(), NULL, 0);
-    guid.Data2 = (uint16_t)wcstoul(items[2].c_str(), NULL, 0);
-    guid.Data3 = (uint16_t)wcstoul(items[3].c_str(), NULL, 0);
-    guid.Data4[0] = (uint8_t)wcstoul(items[4].c_str(), NULL, 0);
-    guid.Data4[1] = (uint8_t)wcstoul(items[5].c_str(), NULL, 0);
-    guid.Data4[2] = (uint8_t)wcstoul(items[6].c_str(), NULL, 0);
-    guid.Data4[3] = (uint8_t)wcstoul(items[7].c_str(), NULL, 0);
-    guid.Data4[4] = (uint8_t)wcstoul(items[8].c_str(), NULL, 0);
-    guid.Data4[5] = (uint8_t)wcstoul(items[9].c_str(), NULL, 0);
-    guid.Data4[6] = (uint8_t)wcstoul(items[10].c_str(), NULL, 0);
-    guid.Data4[7] = (uint8_t)wcstoul(items[11].c_str(), NULL, 0);
+    if (p_name)
+        *p_name = name;
+    if (p_name_len)
+        *p_name_len = name_end - name;
+
+    return true;
+}
+
+bool guid_from_definition(GUID& guid, const char *text, std::string *p_name)
+{
+    const char *name;
+    size_t name_len;
+    if (!guid_parse_definition(guid, text, strlen(text), &name, &name_len))
+        return false;
 
     if (p_name)
-        *p_name = items[0];
+        p_name->assign(name, name_len);
+
+    return true;
+}
+
+bool guid_from_definition(GUID& guid, const char *text)
+{
+    return guid_from_definition(guid, text, NULL);
+}
+
+bool guid_from_definition(GUID& guid, const wchar_t *text, std::wstring *p_name)
+{
+    std::string name;
+    if (!guid_from_definition(guid, guid_ansi_from_wide(text, CP_UTF8).c_str(), p_name ? &name : NULL))
+        return false;
 
+    if (p_name)
+        *p_name = guid_wide_from_ansi(name.c_str(), CP_UTF8);
     return true;
 }
 
@@ -230,156 +346,246 @@ bool guid_from_definition(GUID& guid, const wchar_t *text)
     return guid_from_definition(guid, text, NULL);
 }
 
+bool guid_from_guid_text(GUID& guid, const char *text)
+{
+    if (text[0] == '{' && strlen(text) == GUID_TEXT_LENGTH)
+        return guid_decode_guid_text(guid, text);
+
+    return WonCLSIDFromString(guid_wide_from_ansi(text, CP_UTF8).c_str(), &guid) == S_OK;
+}
+
 bool guid_from_guid_text(GUID& guid, const wchar_t *text)
 {
+    if (text[0] == L'{' && wcslen(text) == GUID_TEXT_LENGTH)
+        return guid_decode_guid_text(guid, text);
+
     return WonCLSIDFromString(text, &guid) == S_OK;
 }
 
-bool guid_from_struct_text(GUID& guid, std::wstring str)
+// Reads count numbers separated by commas
+static const char *guid_read_numbers(const char *pch, const char *end, uint32_t *values, int count)
 {
-    mstr_trim(str, L" \t\r\n");
-    guid_remove_comments(str);
-    mstr_trim(str, L" \t\r\n");
-
-    int level = 0;
-    for (size_t ich = 0; ich < str.size(); ++ich)
+    for (int i = 0; i < count; ++i)
     {
-        if (str[ich] == L'{')
-            ++level;
-        if (str[ich] == L'}')
-            --level;
+        if (i)
+        {
+            pch = guid_expect(pch, end, ',');
+            if (!pch)
+                return NULL;
+        }
+        pch = guid_read_number(guid_skip_space(pch, end), end, values[i]);
+        if (!pch)
+            return NULL;
     }
+    return pch;
+}
 
-    if (level != 0)
-        return false;
+// Reads '}' after an optional comma
+static const char *guid_read_close_brace(const char *pch, const char *end)
+{
+    if (!pch)
+        return NULL;
+    const char *pch2 = guid_expect(pch, end, ',');
+    return guid_expect(pch2 ? pch2 : pch, end, '}');
+}
 
-    if (str.size() && str[str.size() - 1] == L';')
-        str.erase(str.size() - 1, 1);
-    mstr_trim(str, L" \t\r\n");
-    if (str.size() && str[0] == L'{')
-    {
-        str.erase(0, 1);
-    }
-    else
-    {
+bool guid_parse_struct_text(GUID& guid, const char *text, size_t cch)
+{
+    // { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }
+    // { l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8 }
+    const char *end = text + cch;
+    uint32_t values[11];
+    const char *pch = guid_expect(text, end, '{');
+    if (pch)
+        pch = guid_read_numbers(pch, end, values, 3);
+    if (pch)
+        pch = guid_expect(pch, end, ',');
+    if (!pch)
         return false;
-    }
-    mstr_trim(str, L" \t\r\n");
-    if (str.size() && str[str.size() - 1] == L'}')
-    {
-        str.erase(str.size() - 1, 1);
-    }
+
+    const char *pch2 = guid_expect(pch, end, '{');
+    if (pch2)
+        pch = guid_read_close_brace(guid_read_numbers(pch2, end, &values[3], 8), end);
     else
-    {
+        pch = guid_read_numbers(pch, end, &values[3], 8);
+    pch = guid_read_close_brace(pch, end);
+    if (!pch)
         return false;
-    }
-    mstr_trim(str, L" \t\r\n");
 
-    mstr_replace_all(str, L"{", L"");
-    mstr_replace_all(str, L"}", L"");
+    pch = guid_skip_space(pch, end);
+    if (pch < end && *pch == ';')
+        pch = guid_skip_space(pch + 1, end);
+    if (pch != end)
+        return false;
 
-    mstr_replace_all(str, L" ", L"");
-    mstr_replace_all(str, L"\t", L"");
+    guid.Data1 = values[0];
+    guid.Data2 = (uint16_t)values[1];
+    guid.Data3 = (uint16_t)values[2];
+    for (int i = 0; i < 8; ++i)
+        guid.Data4[i] = (uint8_t)values[3 + i];
 
-    mstr_trim(str, L" \t\r\n");
+    return true;
+}
 
-    std::vector<std::wstring> items;
-    mstr_split(items, str, L",");
+bool guid_from_struct_text(GUID& guid, const char *text)
+{
+    return guid_parse_struct_text(guid, text, strlen(text));
+}
 
-    if (items.size() != 11)
-    {
-        return false;
-    }
+bool guid_from_struct_text(GUID& guid, const wchar_t *text)
+{
+    std::string str = guid_ansi_from_wide(text, CP_UTF8);
+    return guid_parse_struct_text(guid, str.c_str(), str.size());
+}
 
-    for (auto& item : items)
+bool guid_parse_hex_text(GUID& guid, const char *text, size_t cch)
+{
+    // The bytes in the order of memory. Other than the 32 hex digits, "0x" and any
+    // characters are skipped
+    uint8_t bytes[sizeof(GUID)];
+    size_t digits = 0;
+    for (const char *pch = text, *end = text + cch; pch < end; ++pch)
     {
-        mstr_trim(item, L" \t");
-        if (!guid_is_valid_value(item.c_str()))
+        if (pch[0] == '0' && pch + 1 < end && pch[1] == 'x')
         {
-            return false;
+            ++pch;
+            continue;
         }
+
+        int value = guid_digit_value(*pch);
+        if (value >= 16)
+            continue;
+        if (digits == 2 * sizeof(bytes))
+            return false;
+
+        if (digits % 2)
+            bytes[digits / 2] |= (uint8_t)value;
+        else
+            bytes[digits / 2] = (uint8_t)(value << 4);
+        ++digits;
     }
 
-    guid.Data1 = (uint32_t)wcstoul(items[0].c_str(), NULL, 0);
-    guid.Data2 = (uint16_t)wcstoul(items[1].c_str(), NULL, 0);
-    guid.Data3 = (uint16_t)wcstoul(items[2].c_str(), NULL, 0);
-    guid.Data4[0] = (uint8_t)wcstoul(items[3].c_str(), NULL, 0);
-    guid.Data4[1] = (uint8_t)wcstoul(items[4].c_str(), NULL, 0);
-    guid.Data4[2] = (uint8_t)wcstoul(items[5].c_str(), NULL, 0);
-    guid.Data4[3] = (uint8_t)wcstoul(items[6].c_str(), NULL, 0);
-    guid.Data4[4] = (uint8_t)wcstoul(items[7].c_str(), NULL, 0);
-    guid.Data4[5] = (uint8_t)wcstoul(items[8].c_str(), NULL, 0);
-    guid.Data4[6] = (uint8_t)wcstoul(items[9].c_str(), NULL, 0);
-    guid.Data4[7] = (uint8_t)wcstoul(items[10].c_str(), NULL, 0);
+    if (digits != 2 * sizeof(bytes))
+        return false;
 
+    memcpy(&guid, bytes, sizeof(bytes));
     return true;
 }
 
-std::wstring guid_to_guid_text(const GUID& guid)
+bool guid_from_hex_text(GUID& guid, const char *text)
+{
+    return guid_parse_hex_text(guid, text, strlen(text));
+}
+
+bool guid_from_hex_text(GUID& guid, const wchar_t *text)
+{
+    return guid_from_hex_text(guid, guid_ansi_from_wide(text, CP_UTF8).c_str());
+}
+
+// Appends a character to ret in UTF-8
+static void guid_append_utf8_char(std::string& ret, uint32_t ch)
 {
-    wchar_t text[40];
-    WonStringFromGUID2(guid, text, _countof(text));
-    return text;
+    if (ch < 0x80)
+    {
+        ret += (char)ch;
+    }
+    else if (ch < 0x800)
+    {
+        ret += (char)(0xC0 | (ch >> 6));
+        ret += (char)(0x80 | (ch & 0x3F));
+    }
+    else if (ch < 0x10000)
+    {
+        ret += (char)(0xE0 | (ch >> 12));
+        ret += (char)(0x80 | ((ch >> 6) & 0x3F));
+        ret += (char)(0x80 | (ch & 0x3F));
+    }
+    else
+    {
+        ret += (char)(0xF0 | (ch >> 18));
+        ret += (char)(0x80 | ((ch >> 12) & 0x3F));
+        ret += (char)(0x80 | ((ch >> 6) & 0x3F));
+        ret += (char)(0x80 | (ch & 0x3F));
+    }
 }
 
 std::string guid_ansi_from_wide(const wchar_t *text, unsigned int cp)
 {
-    char buf[1024];
 #if defined(_WIN32) && !defined(_WON32)
-    ::WideCharToMultiByte(cp, 0, text, -1, buf, _countof(buf), NULL, NULL);
-    buf[_countof(buf) - 1] = 0; // Avoid buffer overrun
+    int cch = ::WideCharToMultiByte(cp, 0, text, -1, NULL, 0, NULL, NULL);
+    if (cch <= 0)
+        return std::string();
+
+    std::string ret(cch - 1, 0);
+    ::WideCharToMultiByte(cp, 0, text, -1, &ret[0], cch, NULL, NULL);
+    return ret;
 #else
-    // ASCII only
-    size_t ich;
-    for (ich = 0; text[ich] && ich < _countof(buf) - 1; ++ich)
+    (void)cp;
+    // UTF-8 for any code page
+    std::string ret;
+    for (; *text; ++text)
     {
-        //assert(text[ich] < 0x80);
-        buf[ich] = (char)text[ich];
+        uint32_t ch = (uint32_t)*text;
+        if (sizeof(wchar_t) == 2 && 0xD800 <= ch && ch < 0xDC00 &&
+            0xDC00 <= (uint32_t)text[1] && (uint32_t)text[1] < 0xE000)
+        {
+            ++text;
+            ch = 0x10000 + ((ch - 0xD800) << 10) + ((uint32_t)*text - 0xDC00);
+        }
+        guid_append_utf8_char(ret, ch);
     }
-    buf[ich] = 0;
+    return ret;
 #endif
-    return buf;
 }
 
 std::wstring guid_wide_from_ansi(const char *text, unsigned int cp)
 {
-    wchar_t buf[1024];
 #if defined(_WIN32) && !defined(_WON32)
-    ::MultiByteToWideChar(cp, 0, text, -1, buf, _countof(buf));
-    buf[_countof(buf) - 1] = 0; // Avoid buffer overrun
+    int cch = ::MultiByteToWideChar(cp, 0, text, -1, NULL, 0);
+    if (cch <= 0)
+        return std::wstring();
+
+    std::wstring ret(cch - 1, 0);
+    ::MultiByteToWideChar(cp, 0, text, -1, &ret[0], cch);
+    return ret;
 #else
-    // ASCII only
-    size_t ich;
-    for (ich = 0; text[ich] && ich < _countof(buf) - 1; ++ich)
+    (void)cp;
+    // UTF-8 for any code page. A broken sequence becomes U+FFFD
+    std::wstring ret;
+    const uint8_t *pb = (const uint8_t *)text;
+    while (*pb)
     {
-        //assert(text[ich] < 0x80);
-        buf[ich] = text[ich];
+        uint32_t ch = *pb++;
+        int trail = (ch >= 0xF0) ? 3 : (ch >= 0xE0) ? 2 : (ch >= 0xC0) ? 1 : 0;
+        if (trail)
+            ch &= 0x3F >> trail;
+        for (; trail && (*pb & 0xC0) == 0x80; --trail)
+            ch = (ch << 6) | (*pb++ & 0x3F);
+        if (trail)
+            ch = 0xFFFD;
+
+        if (sizeof(wchar_t) == 2 && ch >= 0x10000)
+        {
+            ret += (wchar_t)(0xD800 + ((ch - 0x10000) >> 10));
+            ch = 0xDC00 + (ch & 0x3FF);
+        }
+        ret += (wchar_t)ch;
     }
-    buf[ich] = 0;
+    return ret;
 #endif
-    return buf;
 }
 
 GUID_DATA* guid_read_from_file(FILE *fp)
 {
     GUID_DATA *entries = new GUID_DATA;
 
+    // The lines are parsed as UTF-8 as is
     char buf[1024];
+    GUID guid;
+    std::string name;
     while (fgets(buf, sizeof(buf), fp))
     {
-        std::string str = buf;
-        mstr_trim(str, " \t\r\n");
-#if defined(_WIN32) && !defined(_WON32)
-        auto wide = guid_wide_from_ansi(str.c_str(), CP_UTF8);
-#else
-        std::wstring wide;
-        for (size_t i = 0; i < str.size(); ++i)
-            wide += str[i];
-#endif
-
-        GUID guid;
-        std::wstring name;
-        if (guid_from_definition(guid, wide.c_str(), &name))
+        if (guid_from_definition(guid, buf, &name))
             entries->push_back({ name, guid });
     }
 
@@ -417,70 +623,24 @@ void guid_close_data(GUID_DATA *data)
 
 std::wstring guid_to_hex_text(const GUID& guid)
 {
-    std::wstring ret;
-    const uint8_t *pb = (const uint8_t*)&guid;
-    for (size_t ib = 0; ib < sizeof(guid); ++ib)
-    {
-        if (ib)
-            ret += L' ';
-#define HEX L"0123456789ABCDEF"
-        wchar_t sz[3] = { HEX[pb[ib] >> 4], HEX[pb[ib] & 0xF], 0 };
-        ret += sz;
-    }
-    return ret;
-}
-
-bool guid_from_struct_text(GUID& guid, const wchar_t *text)
-{
-    std::wstring str = text;
-    return guid_from_struct_text(guid, str);
+    wchar_t text[GUID_HEX_TEXT_LENGTH + 1];
+    size_t cch = guid_format_hex_text(text, guid);
+    return std::wstring(text, cch);
 }
 
-bool guid_from_hex_text(GUID& guid, const wchar_t *text)
+std::wstring guid_to_guid_text(const GUID& guid)
 {
-    std::wstring str = text;
-    mstr_replace_all(str, L"0x", L"");
-
-    GUID ret;
-    std::vector<uint8_t> bytes;
-    wchar_t sz[3];
-    size_t ich = 0, ib = 0;
-    for (auto ch : str)
-    {
-        if (!iswxdigit(ch))
-            continue;
-        if ((ich % 2) == 0)
-        {
-            sz[0] = ch;
-        }
-        else
-        {
-            sz[1] = ch;
-            sz[2] = 0;
-            uint8_t byte = (uint8_t)wcstoul(sz, NULL, 16);
-            bytes.push_back(byte);
-            ib++;
-        }
-        ich++;
-    }
-
-    if (ib != sizeof(GUID))
-        return false;
-
-    memcpy(&guid, bytes.data(), sizeof(ret));
-    return true;
+    wchar_t text[GUID_TEXT_LENGTH + 1];
+    size_t cch = guid_format_guid_text(text, guid);
+    return std::wstring(text, cch);
 }
 
 std::wstring guid_to_definition(const GUID& guid, const wchar_t *name)
 {
-    wchar_t sz[256];
-    swprintf(sz,
-        L"DEFINE_GUID(%ls, 0x%08X, 0x%04X, 0x%04X, 0x%02X, 0x%02X, 0x%02X, "
-        L"0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X);", (name && name[0] ? name : L"<Name>"),
-        guid.Data1, guid.Data2, guid.Data3,
-        guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
-        guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
-    return sz;
+    std::wstring ret;
+    ret.resize(guid_format_definition(&ret[0], 0, guid, name));
+    guid_format_definition(&ret[0], ret.size() + 1, guid, name);
+    return ret;
 }
 
 std::wstring guid_to_struct_text(const GUID& guid, const wchar_t *name)
@@ -492,120 +652,257 @@ std::wstring guid_to_struct_text(const GUID& guid, const wchar_t *name)
         ret += name;
         ret += L" = ";
     }
-    wchar_t sz[256];
-    swprintf(sz,
-        L"{ 0x%08X, 0x%04X, 0x%04X, { 0x%02X, 0x%02X, 0x%02X, "
-        L"0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X } }",
-        guid.Data1, guid.Data2, guid.Data3,
-        guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
-        guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
-    ret += sz;
+    wchar_t text[GUID_STRUCT_TEXT_LENGTH + 1];
+    ret.append(text, guid_format_struct_text(text, guid));
     if (name)
         ret += L';';
     return ret;
 }
 
-bool guid_parse(GUID& guid, const wchar_t *text)
+std::string guid_to_hex_text_a(const GUID& guid)
 {
-    if (guid_from_guid_text(guid, text))
-        return true;
-
-    if (guid_from_definition(guid, text))
-        return true;
-
-    if (guid_from_struct_text(guid, text))
-        return true;
-
-    if (guid_from_hex_text(guid, text))
-        return true;
-
-    return false;
+    char text[GUID_HEX_TEXT_LENGTH + 1];
+    size_t cch = guid_format_hex_text(text, guid);
+    return std::string(text, cch);
 }
 
-std::wstring guid_dump(const GUID& guid, const wchar_t *name)
+std::string guid_to_guid_text_a(const GUID& guid)
 {
-    if (name && name[0] == 0)
-        name = NULL;
-
-    std::wstring ret;
-
-    auto define_guid = guid_to_definition(guid, name);
-    ret += define_guid;
-    ret += L"\n\n";
-
-    auto guid_text = guid_to_guid_text(guid);
-    ret += L"GUID: ";
-    ret += guid_text;
-    ret += L"\n\n";
-
-    auto hex_text = guid_to_hex_text(guid);
-    ret += L"Hex: ";
-    ret += hex_text;
-    ret += L"\n\n";
-
-    auto struct_text = guid_to_struct_text(guid, name);
-    if (!name)
-        ret += L"Struct: ";
-    ret += struct_text;
-    ret += L"\n";
-
-    return ret;
+    char text[GUID_TEXT_LENGTH + 1];
+    size_t cch = guid_format_guid_text(text, guid);
+    return std::string(text, cch);
 }
 
-bool guid_is_definition(const wchar_t *text)
+std::string guid_to_definition_a(const GUID& guid, const char *name)
 {
-    GUID guid;
-    return guid_from_definition(guid, text, NULL);
+    std::string ret;
+    ret.resize(guid_format_definition(&ret[0], 0, guid, name));
+    guid_format_definition(&ret[0], ret.size() + 1, guid, name);
+    return ret;
 }
 
-bool guid_is_guid_text(const wchar_t *text)
+std::string guid_to_struct_text_a(const GUID& guid, const char *name)
 {
-    GUID guid;
-    return guid_from_guid_text(guid, text);
+    std::string ret;
+    if (name)
+    {
+        ret += "const GUID ";
+        ret += name;
+        ret += " = ";
+    }
+    char text[GUID_STRUCT_TEXT_LENGTH + 1];
+    ret.append(text, guid_format_struct_text(text, guid));
+    if (name)
+        ret += ';';
+    return ret;
 }
 
-bool guid_is_hex_text(const wchar_t *text)
+GUID_FORMAT guid_classify(const char *text, size_t cch)
 {
-    std::wstring str = text;
+    const char *end = text + cch;
+    const char *pch = guid_skip_space(text, end);
+    if (pch == end)
+        return GUID_FORMAT_UNKNOWN;
 
-    mstr_trim(str, L" \t\r\n");
-    mstr_replace_all(str, L"0x", L"");
-    mstr_replace_all(str, L",", L"");
-    mstr_replace_all(str, L" ", L"");
-    mstr_replace_all(str, L"\t", L"");
+    if (*pch == '{')
+    {
+        // "{XXXXXXXX-" or "{ 0x..."
+        if (end - pch > 9 && pch[9] == '-')
+        {
+            int i;
+            for (i = 1; i <= 8 && guid_digit_value(pch[i]) < 16; ++i)
+                ;
+            if (i > 8)
+                return GUID_FORMAT_GUID_TEXT;
+        }
 
-    if (str.size() != 32)
-        return false;
+        // "{ 0xXX, ... }" of the 16 bytes, without the inner braces of a structure
+        const char *pc;
+        int commas = 0;
+        for (pc = pch + 1; pc < end && *pc != '{' && *pc != '}'; ++pc)
+        {
+            if (*pc == ',')
+                ++commas;
+        }
+        if (pc < end && *pc == '}' && commas == 15)
+            return GUID_FORMAT_HEX_TEXT;
+        return GUID_FORMAT_STRUCT_TEXT;
+    }
 
-    for (auto& ch : str)
+    if (guid_has_prefix(pch, end, "DEFINE_GUID", 11) || guid_has_prefix(pch, end, "EXTERN_GUID", 11) ||
+        guid_has_prefix(pch, end, "DEFINE_CODECAPI_GUID", 20) ||
+        guid_has_prefix(pch, end, "MIDL_DEFINE_GUID", 16) ||
+        guid_has_prefix(pch, end, "DEFINE_OLEGUID", 14))
     {
-        if (!iswxdigit(ch))
+        return GUID_FORMAT_DEFINITION;
+    }
+
+    return GUID_FORMAT_HEX_TEXT;
+}
+
+GUID_FORMAT guid_parse(GUID& guid, const char *text, size_t cch, GUID_FORMAT format)
+{
+    if (format == GUID_FORMAT_UNKNOWN)
+        format = guid_classify(text, cch);
+
+    bool ok = false;
+    switch (format)
+    {
+    case GUID_FORMAT_UNKNOWN:
+        break;
+    case GUID_FORMAT_GUID_TEXT:
+        {
+            const char *end = text + cch;
+            const char *pch = guid_skip_space(text, end);
+            while (end > pch && guid_is_space(end[-1]))
+                --end;
+            ok = (end - pch == GUID_TEXT_LENGTH && guid_decode_guid_text(guid, pch));
+        }
+        break;
+    case GUID_FORMAT_DEFINITION:
+        ok = guid_parse_definition(guid, text, cch);
+        break;
+    case GUID_FORMAT_STRUCT_TEXT:
+        ok = guid_parse_struct_text(guid, text, cch);
+        break;
+    case GUID_FORMAT_HEX_TEXT:
+        ok = guid_parse_hex_text(guid, text, cch);
+#if defined(_WIN32) && !defined(_WON32)
+        // A ProgID such as "Shell.Application"
+        if (!ok && guid_from_guid_text(guid, std::string(text, cch).c_str()))
+            return GUID_FORMAT_GUID_TEXT;
+#endif
+        break;
+    }
+
+    return ok ? format : GUID_FORMAT_UNKNOWN;
+}
+
+bool guid_parse(GUID& guid, const char *text)
+{
+    return guid_parse(guid, text, strlen(text)) != GUID_FORMAT_UNKNOWN;
+}
+
+bool guid_parse(GUID& guid, const wchar_t *text)
+{
+    return guid_parse(guid, guid_ansi_from_wide(text, CP_UTF8).c_str());
+}
+
+std::string guid_dump_a(const GUID& guid, const char *name)
+{
+    if (name && name[0] == 0)
+        name = NULL;
+
+    std::string ret = guid_to_definition_a(guid, name);
+    ret.reserve(ret.size() * 3 + GUID_TEXT_LENGTH + GUID_HEX_TEXT_LENGTH + GUID_STRUCT_TEXT_LENGTH);
+    ret += "\n\n";
+
+    char text[GUID_STRUCT_TEXT_LENGTH + 1];
+    ret += "GUID: ";
+    ret.append(text, guid_format_guid_text(text, guid));
+    ret += "\n\n";
+
+    ret += "Hex: ";
+    ret.append(text, guid_format_hex_text(text, guid));
+    ret += "\n\n";
+
+    if (name)
+    {
+        ret += "const GUID ";
+        ret += name;
+        ret += " = ";
+    }
+    else
+    {
+        ret += "Struct: ";
+    }
+    ret.append(text, guid_format_struct_text(text, guid));
+    if (name)
+        ret += ';';
+    ret += "\n";
+
+    return ret;
+}
+
+std::wstring guid_dump(const GUID& guid, const wchar_t *name)
+{
+    std::string str = name ? guid_ansi_from_wide(name, CP_UTF8) : std::string();
+    return guid_wide_from_ansi(guid_dump_a(guid, str.c_str()).c_str(), CP_UTF8);
+}
+
+bool guid_is_definition(const char *text)
+{
+    GUID guid;
+    return guid_from_definition(guid, text, NULL);
+}
+
+bool guid_is_definition(const wchar_t *text)
+{
+    GUID guid;
+    return guid_from_definition(guid, text, NULL);
+}
+
+bool guid_is_guid_text(const char *text)
+{
+    GUID guid;
+    return guid_from_guid_text(guid, text);
+}
+
+bool guid_is_guid_text(const wchar_t *text)
+{
+    GUID guid;
+    return guid_from_guid_text(guid, text);
+}
+
+bool guid_is_hex_text(const char *text)
+{
+    std::string str = text;
+
+    mstr_trim(str, " \t\r\n");
+    mstr_replace_all(str, "0x", "");
+    mstr_replace_all(str, ",", "");
+    mstr_replace_all(str, " ", "");
+    mstr_replace_all(str, "\t", "");
+
+    if (str.size() != 32)
+        return false;
+
+    for (auto& ch : str)
+    {
+        if (!isxdigit((uint8_t)ch))
             return false;
     }
 
     return true;
 }
 
-bool guid_is_struct_text(const wchar_t *text)
+bool guid_is_hex_text(const wchar_t *text)
+{
+    return guid_is_hex_text(guid_ansi_from_wide(text, CP_UTF8).c_str());
+}
+
+bool guid_is_struct_text(const char *text)
 {
     GUID guid;
     return guid_from_struct_text(guid, text);
 }
 
-void guid_random_generate(GUID& guid)
+bool guid_is_struct_text(const wchar_t *text)
 {
-    CoCreateGuid(&guid);
+    GUID guid;
+    return guid_from_struct_text(guid, text);
 }
 
-bool guid_search_by_name(GUID_FOUND& found, const GUID_DATA *data, const wchar_t *name)
+bool guid_search_by_name(GUID_FOUND& found, const GUID_DATA *data, const char *name)
 {
-    std::wstring strName = name;
-    _wcsupr(&strName[0]);
+    std::string strName = name;
+    guid_upper_ascii(strName);
 
+    std::string entry_name;
     for (auto& entry : *data)
     {
-        std::wstring entry_name = entry.name;
-        _wcsupr(&entry_name[0]);
+        entry_name = entry.name;
+        guid_upper_ascii(entry_name);
 
         if (entry_name == strName)
         {
@@ -617,6 +914,11 @@ bool guid_search_by_name(GUID_FOUND& found, const GUID_DATA *data, const wchar_t
     return false;
 }
 
+bool guid_search_by_name(GUID_FOUND& found, const GUID_DATA *data, const wchar_t *name)
+{
+    return guid_search_by_name(found, data, guid_ansi_from_wide(name, CP_UTF8).c_str());
+}
+
 bool guid_search_by_guid(GUID_FOUND& found, const GUID_DATA *data, const GUID& guid)
 {
     for (auto& entry : *data)
@@ -627,40 +929,37 @@ bool guid_search_by_guid(GUID_FOUND& found, const GUID_DATA *data, const GUID& g
     return !found.empty();
 }
 
-bool guid_search_by_text(GUID_FOUND& found, const GUID_DATA *data, const wchar_t *text)
+bool guid_search_by_text(GUID_FOUND& found, const GUID_DATA *data, const char *text)
 {
-    std::wstring str = text;
-    _wcsupr(&str[0]);
+    std::string str = text;
+    guid_upper_ascii(str);
 
     for (auto& entry : *data)
     {
-        auto def_text = guid_to_definition(entry.guid, entry.name.c_str());
-        _wcsupr(&def_text[0]);
+        auto def_text = guid_to_definition_a(entry.guid, entry.name.c_str());
+        guid_upper_ascii(def_text);
         if (def_text.find(str) != def_text.npos)
         {
             found.push_back(entry);
             continue;
         }
 
-        auto guid_text = guid_to_guid_text(entry.guid);
-        _wcsupr(&guid_text[0]);
+        auto guid_text = guid_to_guid_text_a(entry.guid);
         if (guid_text.find(str) != guid_text.npos)
         {
             found.push_back(entry);
             continue;
         }
 
-        auto struct_text = guid_to_struct_text(entry.guid);
-        _wcsupr(&struct_text[0]);
+        auto struct_text = guid_to_struct_text_a(entry.guid);
+        guid_upper_ascii(struct_text);
         if (struct_text.find(str) != struct_text.npos)
         {
             found.push_back(entry);
             continue;
         }
 
-        auto hex_text = guid_to_hex_text(entry.guid);
-        _wcsupr(&hex_text[0]);
-
+        auto hex_text = guid_to_hex_text_a(entry.guid);
         if (hex_text.find(str) != hex_text.npos)
         {
             found.push_back(entry);
@@ -671,7 +970,37 @@ bool guid_search_by_text(GUID_FOUND& found, const GUID_DATA *data, const wchar_t
     return !found.empty();
 }
 
-#if defined(_WIN32) && !defined(_WON32)
+bool guid_search_by_text(GUID_FOUND& found, const GUID_DATA *data, const wchar_t *text)
+{
+    return guid_search_by_text(found, data, guid_ansi_from_wide(text, CP_UTF8).c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Scanning
+//
+// The input is scanned in windows of GUID_SCAN_CHUNK bytes plus GUID_SCAN_OVERLAP bytes of
+// lookahead, so that the memory needed doesn't depend on the size of the input. A GUID belongs
+// to the window where its text starts; it's neither lost nor doubled at a boundary as long as
+// its text is shorter than the lookahead. As all the keywords are ASCII, UTF-8 is scanned as
+// is, and UTF-16 is narrowed to UTF-8 a window at a time. The windows of memory can be scanned
+// in any order, so that they are spread over threads. The definitions in GUID_SCAN_LOOKBACK
+// bytes before a window are looked for again, only to skip the GUID text in those that go on
+// into the window.
+
+#ifndef GUID_SCAN_CHUNK
+    #define GUID_SCAN_CHUNK     ((size_t)4 * 1024 * 1024)
+#endif
+#ifndef GUID_SCAN_OVERLAP
+    #define GUID_SCAN_OVERLAP   ((size_t)64 * 1024)
+#endif
+// Even for UTF-16, and no more than half of a chunk to leave room for it in guid_scan_fp
+#define GUID_SCAN_LOOKBACK  (std::min(GUID_SCAN_OVERLAP, GUID_SCAN_CHUNK / 2) & ~(size_t)1)
+
+// guid_map_file_a maps the file rather than reading all of it
+#if (defined(_WIN32) && !defined(_WON32)) || defined(__unix__) || defined(__APPLE__)
+    #define GUID_SCAN_MAP
+#endif
+
 enum ENCODING
 {
     ENCODING_UTF8 = 0,
@@ -679,264 +1008,397 @@ enum ENCODING
     ENCODING_UTF16BE = 2,
 };
 
-static bool guid_scan_text(GUID_FOUND& found, void *ptr, size_t size, ENCODING encoding)
+// Detects the encoding from the first 3 bytes. Returns the size of the BOM
+static size_t guid_scan_encoding(const uint8_t *bom, ENCODING& encoding)
 {
-    size_t cw = size / sizeof(uint16_t);
+    if (memcmp(bom, "\xEF\xBB\xBF", 3) == 0)
+    {
+        encoding = ENCODING_UTF8;
+        return 3;
+    }
+    if (memcmp(bom, "\xFF\xFE", 2) == 0)
+    {
+        encoding = ENCODING_UTF16LE;
+        return 2;
+    }
+    if (memcmp(bom, "\xFE\xFF", 2) == 0)
+    {
+        encoding = ENCODING_UTF16BE;
+        return 2;
+    }
+
+    if (bom[0] && !bom[1])
+        encoding = ENCODING_UTF16LE;
+    else if (!bom[0] && bom[1])
+        encoding = ENCODING_UTF16BE;
+    else
+        encoding = ENCODING_UTF8;
+    return 0;
+}
 
-    if (encoding == ENCODING_UTF16BE)
+// Appends UTF-16 text to ret as UTF-8
+static void guid_narrow_utf16(std::string& ret, const uint8_t *pb, size_t size, bool big_endian)
+{
+    for (; size >= 2; pb += 2, size -= 2)
     {
-        uint16_t *pw = (uint16_t *)ptr;
-        while (cw-- > 0)
+        uint32_t ch = big_endian ? ((pb[0] << 8) | pb[1]) : (pb[0] | (pb[1] << 8));
+        if (ch < 0x80)
         {
-            auto low = *pw & 0xFF;
-            auto high = (*pw >> 8) & 0xFF;
-            *pw++ = (low << 8) | high;
+            ret += (char)ch;
+            continue;
         }
-        return guid_scan_text(found, ptr, size, ENCODING_UTF16LE);
+
+        if (0xD800 <= ch && ch < 0xDC00 && size >= 4)
+        {
+            uint32_t ch2 = big_endian ? ((pb[2] << 8) | pb[3]) : (pb[2] | (pb[3] << 8));
+            if (0xDC00 <= ch2 && ch2 < 0xE000)
+            {
+                ch = 0x10000 + ((ch - 0xD800) << 10) + (ch2 - 0xDC00);
+                pb += 2;
+                size -= 2;
+            }
+        }
+        guid_append_utf8_char(ret, ch);
     }
+}
 
+// Moves a split point of a window back to the start of a character
+static size_t guid_scan_split(const uint8_t *pb, size_t size, size_t split, ENCODING encoding)
+{
+    if (split >= size)
+        return size;
     if (encoding == ENCODING_UTF8)
     {
-        int cchW = MultiByteToWideChar(CP_UTF8, 0, (char *)ptr, (INT)size, NULL, 0);
-        wchar_t *pszW = (wchar_t *)malloc((cchW + 1) * sizeof(wchar_t));
-        if (!pszW)
-            return false;
-        MultiByteToWideChar(CP_UTF8, 0, (char *)ptr, (INT)size, pszW, cchW);
-        bool ret = guid_scan_text(found, pszW, cchW, ENCODING_UTF16LE);
-        free(pszW);
-        return ret;
+        // Over the continuation bytes, at most three of a valid character
+        for (int i = 0; i < 3 && split > 1 && (pb[split] & 0xC0) == 0x80; ++i)
+            --split;
+        return split;
+    }
+
+    // Keep a surrogate pair together
+    split &= ~size_t(1);
+    if (split >= 4)
+    {
+        const uint8_t *pw = &pb[split - 2];
+        uint32_t ch = (encoding == ENCODING_UTF16BE) ? ((pw[0] << 8) | pw[1]) : (pw[0] | (pw[1] << 8));
+        if (0xD800 <= ch && ch < 0xDC00)
+            split -= 2;
     }
+    return split;
+}
+
+// The keywords that begin a GUID in text. Longer ones first, so that of the keywords ending at
+// the same place, the one starting earlier is tried first
+enum GUID_SCAN_KEYWORD
+{
+    GUID_SCAN_DEFINE_CODECAPI_GUID,
+    GUID_SCAN_MIDL_DEFINE_GUID,
+    GUID_SCAN_DEFINE_GUID,
+    GUID_SCAN_EXTERN_GUID,
+    GUID_SCAN_CONST,
+    GUID_SCAN_KEYWORD_COUNT
+};
 
-    assert(encoding == ENCODING_UTF16LE);
+static const char *const s_scan_keywords[GUID_SCAN_KEYWORD_COUNT] =
+{
+    "DEFINE_CODECAPI_GUID", "MIDL_DEFINE_GUID", "DEFINE_GUID", "EXTERN_GUID", "const"
+};
 
-    const wchar_t *pszW = (const wchar_t *)ptr;
+#define GUID_SCAN_LONGEST       20  // "DEFINE_CODECAPI_GUID"
+#define GUID_SCAN_MAX_STATES    72  // More than the total length of the keywords
+
+// An Aho-Corasick automaton of the keywords, with the transitions of all the bytes filled in.
+// A non-ASCII byte goes back to state 0, as no keyword has one
+struct GUID_SCAN_DFA
+{
+    uint8_t next[GUID_SCAN_MAX_STATES][256];
+    uint8_t output[GUID_SCAN_MAX_STATES];   // The keywords ending at the state, as bits
+    uint8_t length[GUID_SCAN_KEYWORD_COUNT];
 
-    // Scan DEFINE_GUID(...) and EXTERN_GUID(...)
-    bool no_define_guid = false;
-    bool no_extern_guid = false;
-    bool no_codecapi_guid = false;
-    bool no_midl_guid = false;
-    bool no_const = false;
-    for (auto pch = pszW;; )
+    GUID_SCAN_DFA();
+};
+
+GUID_SCAN_DFA::GUID_SCAN_DFA()
+{
+    memset(next, 0, sizeof(next));
+    memset(output, 0, sizeof(output));
+
+    // The trie of the keywords
+    size_t count = 1;
+    for (int k = 0; k < GUID_SCAN_KEYWORD_COUNT; ++k)
     {
-        const wchar_t *pch0 = nullptr;
-        const wchar_t *pch1 = nullptr;
-        const wchar_t *pch5 = nullptr;
-        const wchar_t *pch6 = nullptr;
-        const wchar_t *pch7 = nullptr;
-        if (!no_define_guid)
-        {
-            pch0 = wcsstr(pch, L"DEFINE_GUID");
-            if (!pch0)
-                no_define_guid = true;
-        }
-        if (!no_extern_guid)
-        {
-            pch1 = wcsstr(pch, L"EXTERN_GUID");
-            if (!pch1)
-                no_extern_guid = true;
-        }
-        if (!no_codecapi_guid)
-        {
-            pch5 = wcsstr(pch, L"DEFINE_CODECAPI_GUID");
-            if (!pch5)
-                no_codecapi_guid = true;
-        }
-        if (!no_midl_guid)
+        uint8_t state = 0;
+        for (const char *pch = s_scan_keywords[k]; *pch; ++pch)
         {
-            pch6 = wcsstr(pch, L"MIDL_DEFINE_GUID");
-            if (!pch6)
-                no_midl_guid = true;
+            uint8_t& to = next[state][(uint8_t)*pch];
+            if (!to)
+                to = (uint8_t)count++;
+            state = to;
         }
-        if (!no_const)
-        {
-            pch7 = wcsstr(pch, L"const");
-            if (!pch7)
-                no_const = true;
-        }
-        if (!pch0 && pch1)
-            pch0 = pch1;
-        if (!pch0 && pch5)
-            pch0 = pch5;
-        if (!pch0 && pch6)
-            pch0 = pch6;
-        if (!pch0 && pch7)
-            pch0 = pch7;
-        if (pch0 > pch1 && pch1)
-            pch0 = pch1;
-        if (pch0 > pch5 && pch5)
-            pch0 = pch5;
-        if (pch0 > pch6 && pch6)
-            pch0 = pch6;
-        if (pch0 > pch7 && pch7)
-            pch0 = pch7;
-        if (!pch0)
-            break;
+        output[state] |= 1 << k;
+        length[k] = (uint8_t)strlen(s_scan_keywords[k]);
+    }
+    assert(count <= GUID_SCAN_MAX_STATES);
 
-        if (pch0 == pch7)
+    // Breadth first, the failure links complete the transitions
+    uint8_t fail[GUID_SCAN_MAX_STATES] = { 0 }, queue[GUID_SCAN_MAX_STATES];
+    size_t head = 0, tail = 0;
+    for (int ch = 0; ch < 256; ++ch)
+    {
+        if (next[0][ch])
+            queue[tail++] = next[0][ch];
+    }
+    while (head < tail)
+    {
+        uint8_t state = queue[head++];
+        output[state] |= output[fail[state]];
+        for (int ch = 0; ch < 256; ++ch)
         {
-            if (!iswspace(pch0[5]))
+            uint8_t to = next[state][ch];
+            if (to)
             {
-                pch = pch0 + 5;
-                continue;
+                fail[to] = next[fail[state]][ch];
+                queue[tail++] = to;
             }
-            pch0 += 5; // "const"
-
-            const wchar_t *pch10 = pch0;
-            while (*pch0 && iswspace(*pch0))
-                ++pch0;
-
-            // GUID
-            if (memcmp(pch0, L"GUID", 4 * sizeof(wchar_t)) != 0 || !iswspace(pch0[4]))
+            else
             {
-                pch = pch10 + 1;
-                continue;
+                next[state][ch] = next[fail[state]][ch];
             }
-            pch0 += 4;
+        }
+    }
+}
 
-            // identifier
-            std::wstring name;
-            for (;;)
-            {
-                if (*pch0 && iswspace(*pch0))
-                    ++pch0;
-
-                if (!iswalpha(*pch0) && *pch0 != L'_')
-                {
-                    name.clear();
-                    break;
-                }
-
-                do
-                {
-                    name += *pch0;
-                    ++pch0;
-                } while (*pch0 && (iswalnum(*pch0) || *pch0 == L'_'));
-
-                if (name == L"OLEDBDECLSPEC")
-                {
-                    name.clear();
-                    continue;
-                }
+static const GUID_SCAN_DFA& guid_scan_dfa(void)
+{
+    static const GUID_SCAN_DFA s_dfa;
+    return s_dfa;
+}
 
-                break;
-            }
+// A bare GUID text next to these would be a part of longer text
+static inline bool guid_scan_is_hex_or_dash(char ch)
+{
+    return ('0' <= ch && ch <= '9') || ('A' <= (ch & ~0x20) && (ch & ~0x20) <= 'F') || ch == '-';
+}
 
-            if (name.empty())
-            {
-                pch = pch10 + 1;
-                continue;
-            }
+static inline bool guid_scan_is_space(char ch)
+{
+    return ch == ' ' || ('\t' <= ch && ch <= '\r');
+}
 
-            while (*pch0 && iswspace(*pch0))
-                ++pch0;
+static inline bool guid_scan_is_alpha(char ch)
+{
+    return ('A' <= ch && ch <= 'Z') || ('a' <= ch && ch <= 'z') || ch == '_';
+}
 
-            // "="
-            if (*pch0 != L'=')
-            {
-                pch = pch10 + 1;
-                continue;
-            }
-            ++pch0;
+static inline bool guid_scan_is_alnum(char ch)
+{
+    return guid_scan_is_alpha(ch) || ('0' <= ch && ch <= '9');
+}
 
-            while (*pch0 && iswspace(*pch0))
-                ++pch0;
+static inline const char *guid_scan_skip_space(const char *pch, const char *end)
+{
+    while (pch < end && guid_scan_is_space(*pch))
+        ++pch;
+    return pch;
+}
 
-            if (*pch0 != L'{')
-            {
-                pch = pch10 + 1;
-                continue;
-            }
+// "DEFINE_GUID(...)" and the like at pch. Returns the end of it, or NULL if none
+static const char *guid_scan_definition(GUID_FOUND& found, const char *pch, const char *end)
+{
+    const char *pch2 = (const char *)memchr(pch, ')', end - pch);
+    if (!pch2)
+        return NULL;
 
-            const wchar_t *pch11 = pch0;
-            int level = 0;
-            while (*pch0)
-            {
-                if (*pch0 == ';' || *pch0 == '=')
-                {
-                    pch11 = pch0;
-                    break;
-                }
-                if (*pch0 == '{')
-                    ++level;
-                if (*pch0 == '}')
-                {
-                    --level;
-                    if (level == 0)
-                        break;
-                }
-                ++pch0;
-            }
+    GUID_ENTRY entry;
+    const char *name;
+    size_t name_len;
+    if (!guid_parse_definition(entry.guid, pch, pch2 + 1 - pch, &name, &name_len))
+        return NULL;
 
-            GUID guid;
-            std::wstring str(pch11, pch0 - pch11 + 1);
-            if (guid_from_struct_text(guid, str))
-            {
-                GUID_ENTRY entry;
-                entry.name = name;
-                entry.guid = guid;
-                found.push_back(entry);
-                pch = pch0 + 1;
-                continue;
-            }
+    entry.name.assign(name, name_len);
+    found.push_back(entry);
+    return pch2 + 1;
+}
 
-            pch = pch11;
-            continue;
-        }
+// "const GUID name = {...}" at pch. Returns the end of it, or NULL if none
+static const char *guid_scan_struct(GUID_FOUND& found, const char *pch, const char *end)
+{
+    pch += 5; // "const"
+    if (pch == end || !guid_scan_is_space(*pch))
+        return NULL;
+    pch = guid_scan_skip_space(pch, end);
 
-        auto pch2 = wcschr(pch0, L')');
-        if (!pch2)
-        {
-            pch = pch0 + 1;
-            continue;
-        }
+    // GUID
+    if (end - pch < 5 || memcmp(pch, "GUID", 4) != 0 || !guid_scan_is_space(pch[4]))
+        return NULL;
+    pch += 4;
 
-        GUID guid;
-        std::wstring str(pch0, pch2 - pch0 + 1), name;
-        if (guid_from_definition(guid, str.c_str(), &name))
-        {
-            GUID_ENTRY entry;
-            entry.name = name;
-            entry.guid = guid;
-            found.push_back(entry);
-            pch = pch2 + 1;
-            continue;
-        }
+    // identifier
+    const char *name, *name_end;
+    for (;;)
+    {
+        if (pch < end && guid_scan_is_space(*pch))
+            ++pch;
+
+        if (pch == end || !guid_scan_is_alpha(*pch))
+            return NULL;
 
-        pch = pch0 + 1;
+        name = pch;
+        while (pch < end && guid_scan_is_alnum(*pch))
+            ++pch;
+        name_end = pch;
+
+        if (name_end - name != 13 || memcmp(name, "OLEDBDECLSPEC", 13) != 0)
+            break;
     }
 
-    // Scan {GUID}
-    for (auto pch = pszW;; )
+    // "="
+    pch = guid_scan_skip_space(pch, end);
+    if (pch == end || *pch != '=')
+        return NULL;
+    pch = guid_scan_skip_space(pch + 1, end);
+
+    if (pch == end || *pch != '{')
+        return NULL;
+
+    // Up to the matching '}', or to ';' or '=' to fail
+    const char *start = pch;
+    int level = 0;
+    for (; pch < end; ++pch)
     {
-        auto pch0 = wcsstr(pch, L"{");
-        if (!pch0)
+        if (*pch == ';' || *pch == '=')
+            return NULL;
+        if (*pch == '{')
+            ++level;
+        if (*pch == '}' && --level == 0)
             break;
+    }
+    if (pch == end)
+        return NULL;
+
+    GUID_ENTRY entry;
+    if (!guid_parse_struct_text(entry.guid, start, pch + 1 - start))
+        return NULL;
 
-        auto pch1 = wcschr(pch0, L'}');
-        if (pch1 == nullptr)
+    entry.name.assign(name, name_end);
+    found.push_back(entry);
+    return pch + 1;
+}
+
+// The text of a definition or a struct found, in order
+typedef std::vector<std::pair<const char *, const char *> > GUID_SCAN_SPANS;
+
+// Bare or braced "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" starting before limit, but not in the
+// spans. begin..text is the text before, to see the character before a GUID
+static void guid_scan_bare_text(GUID_FOUND& found, const char *begin, const char *text,
+                                const char *limit, const char *end, const GUID_SCAN_SPANS& spans)
+{
+    const char *stop = (end - limit > GUID_BARE_TEXT_LENGTH - 1) ? limit + GUID_BARE_TEXT_LENGTH - 1 : end;
+    size_t ispan = 0;
+    for (const char *pch = text; (pch = guid_find_bare_text(pch, stop)) != NULL; ++pch)
+    {
+        while (ispan < spans.size() && spans[ispan].second <= pch)
+            ++ispan;
+        if (ispan < spans.size() && spans[ispan].first <= pch)
         {
-            pch = pch0 + 1;
+            pch = spans[ispan].second - 1;
             continue;
         }
 
-        GUID guid;
-        std::wstring str(pch0, pch1 - pch0 + 1);
-        if (guid_from_guid_text(guid, str.c_str()))
+        if (pch > begin && guid_scan_is_hex_or_dash(pch[-1]))
+            continue;
+        if (end - pch > GUID_BARE_TEXT_LENGTH && guid_scan_is_hex_or_dash(pch[GUID_BARE_TEXT_LENGTH]))
+            continue;
+
+        GUID_ENTRY entry;
+        if (guid_decode_bare_text(entry.guid, pch))
         {
-            GUID_ENTRY entry;
-            entry.guid = guid;
             found.push_back(entry);
-            pch = pch1 + 1;
+            pch += GUID_BARE_TEXT_LENGTH - 1;
+        }
+    }
+}
+
+// Scans UTF-8 text for the GUIDs whose text starts in text..limit: the definitions in one pass
+// of the automaton, and then GUID text. The text of a definition found is skipped by the later
+// ones. begin..text is the text before, whose definitions are not found again but skipped
+static void guid_scan_text(GUID_FOUND& found, const char *begin, const char *text,
+                           const char *limit, const char *end)
+{
+    const GUID_SCAN_DFA& dfa = guid_scan_dfa();
+    const char *next_definition = begin;
+    GUID_SCAN_SPANS spans;
+    GUID_FOUND before; // found in the window before
+
+    // No keyword starting before limit ends after this
+    const char *stop = (end - limit > GUID_SCAN_LONGEST) ? limit + GUID_SCAN_LONGEST : end;
+
+    unsigned state = 0;
+    for (const char *pch = begin; pch < stop; ++pch)
+    {
+        // Most characters don't start a keyword
+        if (!state)
+        {
+            while (pch < stop && !dfa.next[0][(uint8_t)*pch])
+                ++pch;
+            if (pch == stop)
+                break;
+        }
+
+        state = dfa.next[state][(uint8_t)*pch];
+        unsigned output = dfa.output[state];
+        if (!output)
             continue;
+
+        for (int k = 0; output; ++k, output >>= 1)
+        {
+            if (!(output & 1))
+                continue;
+
+            const char *start = pch + 1 - dfa.length[k];
+            if (start >= limit || start < next_definition)
+                continue;
+
+            GUID_FOUND& list = (start < text) ? before : found;
+            const char *after;
+            if (k == GUID_SCAN_CONST)
+                after = guid_scan_struct(list, start, end);
+            else
+                after = guid_scan_definition(list, start, end);
+            if (after)
+            {
+                if (after > text)
+                    spans.push_back(std::make_pair(start, after));
+                next_definition = after;
+            }
         }
+    }
+
+    guid_scan_bare_text(found, begin, text, limit, end, spans);
+}
 
-        pch = pch0 + 1;
+// Scans the window for the GUIDs that start before split. pb[-before..-1] is the text before
+// the window, if any, of which GUID_SCAN_LOOKBACK bytes at most are looked at
+static void guid_scan_window(GUID_FOUND& found, std::string& text, const uint8_t *pb,
+                             size_t before, size_t size, size_t split, ENCODING encoding)
+{
+    before = std::min(before, GUID_SCAN_LOOKBACK);
+    if (encoding == ENCODING_UTF8)
+    {
+        const char *pch = (const char *)pb;
+        guid_scan_text(found, pch - before, pch, pch + split, pch + size);
+        return;
     }
 
-    guid_sort_and_unique(found);
+    text.clear();
+    guid_narrow_utf16(text, pb - before, before, encoding == ENCODING_UTF16BE);
+    size_t start = text.size();
+    guid_narrow_utf16(text, pb, split, encoding == ENCODING_UTF16BE);
+    size_t limit = text.size();
+    guid_narrow_utf16(text, pb + split, size - split, encoding == ENCODING_UTF16BE);
 
-    return found.size();
+    const char *pch = text.data();
+    guid_scan_text(found, pch, pch + start, pch + limit, pch + text.size());
 }
 
 void guid_sort_and_unique(GUID_FOUND& found)
@@ -954,60 +1416,151 @@ void guid_sort_and_unique(GUID_FOUND& found)
     }), found.end());
 }
 
-bool guid_scan_fp(GUID_FOUND& found, FILE *fp)
+// Drops the duplicates once they may be half of found, so that found doesn't grow with the input
+static void guid_scan_compact(GUID_FOUND& found, size_t& compacted)
+{
+    if (found.size() >= 2 * compacted + 4096)
+    {
+        guid_sort_and_unique(found);
+        compacted = found.size();
+    }
+}
+
+// The windows of memory. Each begins where the previous one is split
+struct GUID_SCAN_WINDOW
+{
+    size_t offset;
+    size_t size;
+    size_t split;
+};
+
+// Each thread takes the next window into a list of its own. A GUID in an overlap is found only
+// in the window where it begins, and the lists are merged and sorted, so that the result is the
+// same as with a thread
+static void guid_scan_parallel(GUID_FOUND& found, const uint8_t *text,
+                               const std::vector<GUID_SCAN_WINDOW>& windows, ENCODING encoding,
+                               int threads)
+{
+    std::vector<GUID_FOUND> lists(threads);
+    std::atomic<size_t> next(0);
+    auto worker = [&](int index) {
+        GUID_FOUND& list = lists[index];
+        std::string narrow;
+        size_t compacted = 0;
+        for (size_t i; (i = next++) < windows.size(); )
+        {
+            const GUID_SCAN_WINDOW& window = windows[i];
+            guid_scan_window(list, narrow, text + window.offset, window.offset, window.size,
+                             window.split, encoding);
+            guid_scan_compact(list, compacted);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i)
+        pool.emplace_back(worker, i);
+    worker(0);
+    for (auto& thread : pool)
+        thread.join();
+
+    for (auto& list : lists)
+        found.insert(found.end(), list.begin(), list.end());
+}
+
+bool guid_scan_memory(GUID_FOUND& found, const void *ptr, size_t size, int threads)
 {
-    char bom[3];
-    if (!fread(bom, 3, 1, fp))
+    if (size < 3)
         return false;
 
+    const uint8_t *text = (const uint8_t *)ptr;
     ENCODING encoding;
-    if (memcmp(bom, "\xEF\xBB\xBF", 3) == 0)
-    {
-        encoding = ENCODING_UTF8;
-    }
-    else if (memcmp(bom, "\xFF\xFE", 2) == 0)
-    {
-        encoding = ENCODING_UTF16LE;
-        fseek(fp, -1, SEEK_CUR);
-    }
-    else if (memcmp(bom, "\xFE\xFF", 2) == 0)
-    {
-        encoding = ENCODING_UTF16BE;
-        fseek(fp, -1, SEEK_CUR);
-    }
-    else if (bom[0] && !bom[1])
+    size_t bom = guid_scan_encoding(text, encoding);
+    text += bom;
+    size -= bom;
+
+    std::vector<GUID_SCAN_WINDOW> windows;
+    for (size_t offset = 0; offset < size; )
     {
-        encoding = ENCODING_UTF16LE;
-        fseek(fp, -3, SEEK_CUR);
+        GUID_SCAN_WINDOW window;
+        window.offset = offset;
+        window.size = std::min(size - offset, GUID_SCAN_CHUNK + GUID_SCAN_OVERLAP);
+        window.split = (window.size == size - offset) ? window.size : GUID_SCAN_CHUNK;
+        window.split = guid_scan_split(text + offset, window.size, window.split, encoding);
+        windows.push_back(window);
+        offset += window.split;
     }
-    else if (!bom[0] && bom[1])
+
+    if (threads > 1 && windows.size() > 1)
     {
-        encoding = ENCODING_UTF16BE;
-        fseek(fp, -3, SEEK_CUR);
+        guid_scan_parallel(found, text, windows, encoding, std::min(threads, (int)windows.size()));
     }
     else
     {
-        encoding = ENCODING_UTF8;
+        std::string narrow;
+        size_t compacted = found.size();
+        for (auto& window : windows)
+        {
+            guid_scan_window(found, narrow, text + window.offset, window.offset, window.size,
+                             window.split, encoding);
+            guid_scan_compact(found, compacted);
+        }
     }
 
-    std::string binary;
-    char buf[1024];
+    guid_sort_and_unique(found);
+    return !found.empty();
+}
+
+bool guid_scan_fp(GUID_FOUND& found, FILE *fp)
+{
+    // No seeking, for a pipe
+    std::vector<uint8_t> buffer(GUID_SCAN_CHUNK + GUID_SCAN_OVERLAP);
+    uint8_t *pb = buffer.data();
+    size_t size = fread(pb, 1, buffer.size(), fp);
+    if (size < 3)
+        return false;
+
+    ENCODING encoding;
+    size_t start = guid_scan_encoding(pb, encoding), before = 0;
+    size_t origin = start; // where the text after the BOM begins in the buffer
+
+    std::string narrow;
+    size_t compacted = found.size();
     for (;;)
     {
-        size_t size = fread(buf, 1, 1024, fp);
-        if (!size)
+        bool eof = (size < buffer.size());
+        size_t split = eof ? size : size - GUID_SCAN_OVERLAP;
+        split = start + guid_scan_split(pb + start, size - start, split - start, encoding);
+        guid_scan_window(found, narrow, pb + start, before, size - start, split - start, encoding);
+        if (eof)
             break;
-
-        binary.append(buf, size);
+        guid_scan_compact(found, compacted);
+
+        // The lookahead begins the next window, after the text before it
+        before = std::min(split - origin, GUID_SCAN_LOOKBACK);
+        memmove(pb, pb + split - before, size - split + before);
+        size -= split - before;
+        start = before;
+        origin = 0;
+        size += fread(pb + size, 1, buffer.size() - size, fp);
     }
 
-    binary.append(1, 0);
-
-    return guid_scan_text(found, const_cast<char*>(binary.c_str()), binary.size(), encoding);
+    guid_sort_and_unique(found);
+    return !found.empty();
 }
 
-bool guid_scan_file_a(GUID_FOUND& found, const char *fname)
+bool guid_scan_file_a(GUID_FOUND& found, const char *fname, int threads)
 {
+#ifdef GUID_SCAN_MAP
+    // A regular file is mapped. A pipe or a device is streamed
+    size_t size;
+    if (const void *ptr = guid_map_file_a(fname, &size))
+    {
+        bool ret = guid_scan_memory(found, ptr, size, threads);
+        guid_unmap_file(ptr, size);
+        return ret;
+    }
+#endif
+
     FILE *fp = fopen(fname, "rb");
     if (!fp)
         return false;
@@ -1017,8 +1570,17 @@ bool guid_scan_file_a(GUID_FOUND& found, const char *fname)
     return ret;
 }
 
-bool guid_scan_file_w(GUID_FOUND& found, const wchar_t *fname)
+#if defined(_WIN32) && !defined(_WON32)
+bool guid_scan_file_w(GUID_FOUND& found, const wchar_t *fname, int threads)
 {
+    size_t size;
+    if (const void *ptr = guid_map_file_w(fname, &size))
+    {
+        bool ret = guid_scan_memory(found, ptr, size, threads);
+        guid_unmap_file(ptr, size);
+        return ret;
+    }
+
     FILE *fp = _wfopen(fname, L"rb");
     if (!fp)
         return false;
@@ -10,6 +10,7 @@
 #include <vector>
 #include <cstdio> // for FILE
 #include <cstdint>
+#include <mutex>
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -48,12 +49,16 @@ typedef uint32_t HRESULT;
 #define CO_E_CLASSSTRING 0x800401F3
 #endif
 
+#if !defined(_WIN32) || defined(_WON32)
+#define CP_UTF8 65001
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // GUID_ENTRY / GUID_DATA / GUID_FOUND
 
 struct GUID_ENTRY
 {
-    std::wstring name;
+    std::string name;   // UTF-8
     GUID guid;
 };
 typedef std::vector<GUID_ENTRY> GUID_DATA, GUID_FOUND;
@@ -74,13 +79,160 @@ void guid_close_data(GUID_DATA *data);
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-void guid_random_generate(GUID& guid);
-
 bool guid_equal(const GUID& guid1, const GUID& guid2);
 
 std::string guid_ansi_from_wide (const wchar_t *text, unsigned int cp = 0);
 std::wstring guid_wide_from_ansi(const  char   *text, unsigned int cp = 0);
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Random GUIDs
+
+// Fills buf with the entropy of the OS. Slow; for seeding
+bool guid_random_bytes(void *buf, size_t size);
+
+#define GUID_RANDOM_BUFFER_SIZE 256 // four ChaCha20 blocks
+
+// A ChaCha20 keystream to generate random GUIDs in bulk. Not thread-safe; one per thread
+struct GUID_RANDOM
+{
+    uint32_t state[16];
+    uint8_t buffer[GUID_RANDOM_BUFFER_SIZE];
+    size_t used;    // the bytes of buffer already consumed
+};
+
+// Seeds from the OS. Returns false if no entropy is available
+bool guid_random_init(GUID_RANDOM& rng);
+// Seeds with a 32-byte key and a stream number, for reproducible keystreams
+void guid_random_init(GUID_RANDOM& rng, const uint8_t *key, uint64_t stream);
+void guid_random_fill(GUID_RANDOM& rng, void *buf, size_t size);
+
+// Generates version 4 GUIDs (RFC 4122)
+void guid_random_generate(GUID_RANDOM& rng, GUID *guids, size_t count);
+// The portable CoCreateGuid, with a keystream per thread
+bool guid_random_generate(GUID& guid);
+
+// A generator of time-ordered version 7 GUIDs (RFC 9562). Not thread-safe; one per thread
+struct GUID_V7
+{
+    GUID_RANDOM rng;
+    uint64_t last_ms;   // Unix time in milliseconds
+    uint64_t counter;   // 42 bits, random at each new millisecond
+};
+
+bool guid_v7_init(GUID_V7& gen);
+// The GUIDs increase in the text order, even within a millisecond
+void guid_generate_v7(GUID_V7& gen, GUID *guids, size_t count);
+// With a generator per thread
+bool guid_generate_v7(GUID& guid);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Name-based GUIDs (RFC 4122): version 5 with SHA-1 and version 3 with MD5 of the namespace
+// and the name (UTF-8 bytes)
+
+extern const GUID GUID_NAMESPACE_DNS;
+extern const GUID GUID_NAMESPACE_URL;
+extern const GUID GUID_NAMESPACE_OID;
+extern const GUID GUID_NAMESPACE_X500;
+
+void guid_generate_v5(GUID& guid, const GUID& ns, const char *name, size_t cch);
+void guid_generate_v3(GUID& guid, const GUID& ns, const char *name, size_t cch);
+// Hashes many names at once, four in parallel with SSE2
+void guid_generate_v5(GUID *guids, const GUID& ns, const char *const *names, const size_t *lengths,
+                      size_t count);
+void guid_generate_v3(GUID *guids, const GUID& ns, const char *const *names, const size_t *lengths,
+                      size_t count);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Fixed-width GUID text
+
+#define GUID_TEXT_LENGTH 38         // "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}"
+#define GUID_HEX_TEXT_LENGTH 47     // "XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX"
+#define GUID_STRUCT_TEXT_LENGTH 82  // "{ 0xXXXXXXXX, 0xXXXX, 0xXXXX, { 0xXX, ... } }"
+#define GUID_BARE_TEXT_LENGTH 36    // "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"
+
+// Decodes "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}" of exactly 38 characters.
+// No terminator is needed but 38 characters must be readable.
+bool guid_decode_guid_text(GUID& guid, const char *text);
+bool guid_decode_guid_text(GUID& guid, const wchar_t *text);
+// Decodes "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" of exactly 36 characters in either case
+bool guid_decode_bare_text(GUID& guid, const char *text);
+// Finds a candidate for guid_decode_bare_text in text[0..end), at the speed of memchr.
+// Returns NULL if none
+const char *guid_find_bare_text(const char *text, const char *end);
+
+// Formats into a buffer of the length plus one. Returns the length
+size_t guid_format_guid_text(char *buf, const GUID& guid);
+size_t guid_format_guid_text(wchar_t *buf, const GUID& guid);
+size_t guid_format_hex_text(char *buf, const GUID& guid);
+size_t guid_format_hex_text(wchar_t *buf, const GUID& guid);
+size_t guid_format_struct_text(char *buf, const GUID& guid);
+size_t guid_format_struct_text(wchar_t *buf, const GUID& guid);
+
+// Formats "DEFINE_GUID(name, ...);". Returns the length. If cch is not more than the length,
+// nothing is written
+size_t guid_format_definition(char *buf, size_t cch, const GUID& guid, const char *name);
+size_t guid_format_definition(wchar_t *buf, size_t cch, const GUID& guid, const wchar_t *name);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// UTF-8 text. The wchar_t versions below convert to UTF-8 and call them
+
+bool guid_is_valid_value(const char *text);
+
+bool guid_from_definition(GUID& guid, const char *text);
+bool guid_from_definition(GUID& guid, const char *text, std::string *p_name);
+
+// Parses DEFINE_GUID(...) or its variant in text[0..cch) in one pass without allocation.
+// The name is returned as a span of the text
+bool guid_parse_definition(GUID& guid, const char *text, size_t cch,
+                           const char **p_name = NULL, size_t *p_name_len = NULL);
+
+// Parses "{ l, w1, w2, { b1, ..., b8 } }" in text[0..cch) in one pass without allocation
+bool guid_parse_struct_text(GUID& guid, const char *text, size_t cch);
+
+// Reads the 32 hex digits in text[0..cch) as the bytes of a GUID, skipping "0x" and others
+bool guid_parse_hex_text(GUID& guid, const char *text, size_t cch);
+bool guid_from_guid_text(GUID& guid, const char *text);
+bool guid_from_struct_text(GUID& guid, const char *text);
+bool guid_from_hex_text(GUID& guid, const char *text);
+
+std::string guid_to_definition_a(const GUID& guid, const char *name = NULL);
+std::string guid_to_guid_text_a(const GUID& guid);
+std::string guid_to_struct_text_a(const GUID& guid, const char *name = NULL);
+std::string guid_to_hex_text_a(const GUID& guid);
+
+bool guid_is_definition(const char *text);
+bool guid_is_guid_text(const char *text);
+bool guid_is_struct_text(const char *text);
+bool guid_is_hex_text(const char *text);
+
+// The format of GUID text
+enum GUID_FORMAT
+{
+    GUID_FORMAT_UNKNOWN = 0,
+    GUID_FORMAT_GUID_TEXT,      // {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}
+    GUID_FORMAT_DEFINITION,     // DEFINE_GUID(...) and its variants
+    GUID_FORMAT_STRUCT_TEXT,    // { 0x..., 0x..., 0x..., { 0x.., ... } }
+    GUID_FORMAT_HEX_TEXT,       // XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX
+};
+
+// Tells the format of text[0..cch) from its leading characters, without parsing it
+GUID_FORMAT guid_classify(const char *text, size_t cch);
+
+// Parses text[0..cch) with the parser of the format only. If format is GUID_FORMAT_UNKNOWN,
+// the format is classified first. Returns the format parsed or GUID_FORMAT_UNKNOWN
+GUID_FORMAT guid_parse(GUID& guid, const char *text, size_t cch,
+                       GUID_FORMAT format = GUID_FORMAT_UNKNOWN);
+bool guid_parse(GUID& guid, const char *text);
+std::string guid_dump_a(const GUID& guid, const char *name);
+
+bool guid_search_by_name(GUID_FOUND& found, const GUID_DATA *data, const char *name);
+bool guid_search_by_text(GUID_FOUND& found, const GUID_DATA *data, const char *text);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// wchar_t text
+
+bool guid_is_valid_value(const wchar_t *text);
+
 bool guid_from_definition(GUID& guid, const wchar_t *text);
 bool guid_from_definition(GUID& guid, const wchar_t *text, std::wstring *p_name);
 bool guid_from_guid_text(GUID& guid, const wchar_t *text);
@@ -104,12 +256,14 @@ bool guid_search_by_guid(GUID_FOUND& found, const GUID_DATA *data, const GUID& g
 bool guid_search_by_name(GUID_FOUND& found, const GUID_DATA *data, const wchar_t *name);
 bool guid_search_by_text(GUID_FOUND& found, const GUID_DATA *data, const wchar_t *text);
 
-bool guid_is_valid_value(const wchar_t *text);
-
+// Scanning text in UTF-8, UTF-16LE or UTF-16BE for GUIDs. A regular file is mapped and
+// other input is read in chunks, so that the memory needed is bounded. Memory of more than a
+// window (4 MB) is spread over up to threads threads
+bool guid_scan_memory(GUID_FOUND& found, const void *ptr, size_t size, int threads = 1);
+bool guid_scan_fp(GUID_FOUND& found, FILE *fp);
+bool guid_scan_file_a(GUID_FOUND& found, const char *fname, int threads = 1);
 #if defined(_WIN32) && !defined(_WON32)
-    bool guid_scan_fp(GUID_FOUND& found, FILE *fp);
-    bool guid_scan_file_a(GUID_FOUND& found, const char *fname);
-    bool guid_scan_file_w(GUID_FOUND& found, const wchar_t *fname);
+    bool guid_scan_file_w(GUID_FOUND& found, const wchar_t *fname, int threads = 1);
     #ifdef UNICODE
         #define guid_scan_file guid_scan_file_w
     #else
@@ -121,19 +275,160 @@ void guid_sort_and_unique(GUID_FOUND& found);
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// GUID_DB --- The compiled database
+//
+// A compiled database is a flat image that can be memory-mapped and used without parsing:
+//
+//     GUID_DB_HEADER
+//     GUID_DB_RECORD records[count];   // sorted by GUID (memcmp order)
+//     uint32_t order[count];           // record indexes in the order of the source text
+//     char names[names_size];          // interned UTF-8 names, each NUL-terminated
+//     uint32_t hash[hash_size];        // open-addressing index on GUID (see guid_db_find)
+//     char folded[names_size];         // the upper-cased copy of names (same offsets)
+//     uint32_t by_name[count];         // record indexes sorted by folded name
+//     GUID_DB_TRIGRAM trigrams[trigram_count];     // sorted by key
+//     uint8_t postings[postings_size]; // delta-coded varints of source positions
+//
+// All offsets are in bytes from the top of the image. The text format (guid.dat) is still
+// the source of truth; use "rguid --compile guid.dat guid.bin" to make an image. The size and
+// the modification time of the text file are kept to tell if the image is out of date.
+
+#define GUID_DB_MAGIC "RGUIDDB"
+#define GUID_DB_VERSION 5
+#define GUID_DB_NOT_FOUND 0xFFFFFFFF
+
+struct GUID_DB_HEADER
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t records_offset;
+    uint32_t order_offset;
+    uint32_t names_offset;
+    uint32_t names_size;
+    uint32_t hash_offset;
+    uint32_t hash_size;     // power of two
+    uint32_t folded_offset;
+    uint32_t by_name_offset;
+    uint32_t trigrams_offset;
+    uint32_t trigram_count;
+    uint32_t postings_offset;
+    uint32_t postings_size;
+    uint64_t source_size;   // of the compiled text file, or zero
+    int64_t source_mtime;
+};
+
+struct GUID_DB_RECORD
+{
+    GUID guid;
+    uint32_t name_offset;
+    uint32_t name_length;
+};
+
+// The trigram index on the upper-cased text forms that guid_search_by_text looks into.
+// Too common trigrams are not indexed (count is zero). An image without trigrams has no
+// text index; it is built by "rguid --compile" but not when loading a text file.
+struct GUID_DB_TRIGRAM
+{
+    uint32_t key;       // three bytes of UTF-8
+    uint32_t count;     // the number of source positions
+    uint32_t offset;    // offset into postings
+};
+
+// The view of a compiled database
+struct GUID_DB
+{
+    const GUID_DB_RECORD *records;
+    const uint32_t *order;
+    const char *names;
+    const uint32_t *hash;   // the first record index of each GUID plus one, or zero
+    const char *folded;
+    const uint32_t *by_name;
+    const GUID_DB_TRIGRAM *trigrams;
+    const uint8_t *postings;
+    uint32_t count;
+    uint32_t names_size;
+    uint32_t hash_size;
+    uint32_t trigram_count;
+    uint32_t postings_size;
+    uint64_t source_size;
+    int64_t source_mtime;
+};
+
+bool guid_db_build(std::vector<uint8_t>& image, const GUID_DATA *data, bool text_index = true);
+bool guid_db_attach(GUID_DB& db, const void *image, size_t size);
+GUID_DATA* guid_db_decode(const GUID_DB& db);
+
+void guid_db_get_entry(GUID_ENTRY& entry, const GUID_DB& db, uint32_t index);
+uint32_t guid_db_find(const GUID_DB& db, const GUID& guid);
+uint32_t guid_db_find_name(const GUID_DB& db, const char *name);
+
+bool guid_db_search_by_guid(GUID_FOUND& found, const GUID_DB& db, const GUID& guid);
+bool guid_db_search_by_name(GUID_FOUND& found, const GUID_DB& db, const char *name);
+bool guid_db_search_by_name(GUID_FOUND& found, const GUID_DB& db, const wchar_t *name);
+bool guid_db_search_by_text(GUID_FOUND& found, const GUID_DB& db, const char *text);
+bool guid_db_search_by_text(GUID_FOUND& found, const GUID_DB& db, const wchar_t *text);
+
+// Scans binary data for the GUIDs of the database in the memory layout at any byte offset.
+// GUID_NULL is ignored. Each GUID is added once per call. Memory of more than 16 MB is spread
+// over up to threads threads. filter is of guid_db_build_filter for db, or NULL to build it
+// for the call
+void guid_db_build_filter(std::vector<uint64_t>& filter, const GUID_DB& db);
+bool guid_db_scan_binary(GUID_FOUND& found, const GUID_DB& db, const void *ptr, size_t size,
+                         int threads = 1, const uint64_t *filter = NULL);
+bool guid_db_scan_binary_fp(GUID_FOUND& found, const GUID_DB& db, FILE *fp,
+                            const uint64_t *filter = NULL);
+bool guid_db_scan_binary_file_a(GUID_FOUND& found, const GUID_DB& db, const char *fname,
+                                int threads = 1, const uint64_t *filter = NULL);
+#if defined(_WIN32) && !defined(_WON32)
+bool guid_db_scan_binary_file_w(GUID_FOUND& found, const GUID_DB& db, const wchar_t *fname,
+                                int threads = 1, const uint64_t *filter = NULL);
+#endif
+
+bool guid_compile_data_a(const char *data_file, const char *db_file);
+// Whether data_file exists and is not the text file that db was compiled from
+bool guid_db_is_stale(const GUID_DB& db, const char *data_file);
+
+#ifdef RGUID_EMBED_DATABASE
+    // The built-in database generated from guid.dat at build time (see guid_embed.cpp)
+    const GUID_DB& guid_db_embedded(void);
+#endif
+
+const void *guid_map_file_a(const char *fname, size_t *psize);
+#if defined(_WIN32) && !defined(_WON32)
+const void *guid_map_file_w(const wchar_t *fname, size_t *psize);
+#endif
+void guid_unmap_file(const void *ptr, size_t size);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
 class GuidDataBase
 {
-    GUID_DATA *m_data;
+    GUID_DB m_db;
+    std::vector<uint8_t> m_image;   // the image compiled from a text file
+    const void *m_view;             // or the memory-mapped image of a compiled file
+    size_t m_view_size;
+    mutable GUID_DATA *m_data;      // the decoded entries (lazy for compiled files)
+    std::vector<uint64_t> m_filter; // for scanning binary data (lazy)
+    std::mutex m_filter_mutex;
+
+    const uint64_t *filter();
+
+    bool attach_view(const void *view, size_t size);
+    bool attach_data(GUID_DATA *data);
 
 public:
-    GuidDataBase() : m_data(NULL)
+    GuidDataBase() : m_db(), m_view(NULL), m_view_size(0), m_data(NULL)
     {
     }
-    GuidDataBase(const char *filename) : m_data(guid_load_data_a(filename))
+    GuidDataBase(const char *filename) : GuidDataBase()
     {
+        load(filename);
     }
-    GuidDataBase(const wchar_t *filename) : m_data(guid_load_data_w(filename))
+    GuidDataBase(const wchar_t *filename) : GuidDataBase()
     {
+        load(filename);
     }
     ~GuidDataBase()
     {
@@ -142,7 +437,7 @@ public:
 
     size_t size() const
     {
-        return m_data ? m_data->size() : 0;
+        return m_db.count;
     }
 
     bool empty() const
@@ -150,42 +445,93 @@ public:
         return !size();
     }
 
-    bool load(const char *filename)
-    {
-        if (m_data) close();
-        m_data = guid_load_data_a(filename);
-        return is_loaded();
-    }
-    bool load(const wchar_t *filename)
+    bool load(const char *filename);
+    bool load(const wchar_t *filename);
+#ifdef RGUID_EMBED_DATABASE
+    bool load_embedded();
+#endif
+    bool is_loaded() const { return !empty(); }
+    bool is_stale(const char *data_file) const
     {
-        if (m_data) close();
-        m_data = guid_load_data_w(filename);
-        return is_loaded();
+        return guid_db_is_stale(m_db, data_file);
     }
-    bool is_loaded() const { return !!m_data && !empty(); }
 
-    void close()
-    {
-        if (m_data)
-        {
-            guid_close_data(m_data);
-            m_data = NULL;
-        }
-    }
+    void close();
 
     bool search_by_guid(GUID_FOUND& found, const GUID& guid)
     {
-        return guid_search_by_guid(found, m_data, guid);
+        return guid_db_search_by_guid(found, m_db, guid);
+    }
+    bool search_by_name(GUID_FOUND& found, const char *name)
+    {
+        return guid_db_search_by_name(found, m_db, name);
     }
     bool search_by_name(GUID_FOUND& found, const wchar_t *name)
     {
-        return guid_search_by_name(found, m_data, name);
+        return guid_db_search_by_name(found, m_db, name);
+    }
+    bool search_by_text(GUID_FOUND& found, const char *text)
+    {
+        return guid_db_search_by_text(found, m_db, text);
     }
     bool search_by_text(GUID_FOUND& found, const wchar_t *text)
     {
-        return guid_search_by_text(found, m_data, text);
+        return guid_db_search_by_text(found, m_db, text);
+    }
+    bool scan_binary(GUID_FOUND& found, const void *ptr, size_t size, int threads = 1)
+    {
+        return guid_db_scan_binary(found, m_db, ptr, size, threads, filter());
+    }
+    bool scan_binary_fp(GUID_FOUND& found, FILE *fp)
+    {
+        return guid_db_scan_binary_fp(found, m_db, fp, filter());
+    }
+    bool scan_binary_file(GUID_FOUND& found, const char *fname, int threads = 1)
+    {
+        return guid_db_scan_binary_file_a(found, m_db, fname, threads, filter());
     }
+#if defined(_WIN32) && !defined(_WON32)
+    bool scan_binary_file(GUID_FOUND& found, const wchar_t *fname, int threads = 1)
+    {
+        return guid_db_scan_binary_file_w(found, m_db, fname, threads, filter());
+    }
+#endif
+
+    const GUID_DB& db() const { return m_db; }
+
+          GUID_DATA& data()       { return decoded(); };
+    const GUID_DATA& data() const { return decoded(); };
+
+private:
+    GUID_DATA& decoded() const
+    {
+        if (!m_data)
+            m_data = guid_db_decode(m_db);
+        return *m_data;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// GuidReservoir --- Pre-generated random GUIDs
+//
+// A lock-free ring of version 4 GUIDs that a background thread refills in batches, so that
+// take() costs one atomic dequeue instead of a call to guid_random_generate. If the ring is
+// empty, take() generates one on the calling thread.
+
+struct GUID_RESERVOIR;
+
+class GuidReservoir
+{
+    GUID_RESERVOIR *m_impl;
+
+    GuidReservoir(const GuidReservoir&);
+    GuidReservoir& operator=(const GuidReservoir&);
+
+public:
+    // capacity is rounded up to a power of two. Refilling starts when a quarter is left
+    explicit GuidReservoir(size_t capacity = 4096);
+    ~GuidReservoir();
 
-          GUID_DATA& data()       { return *m_data; };
-    const GUID_DATA& data() const { return *m_data; };
+    bool take(GUID& guid);
+    size_t size() const;    // approximate
 };
@@ -0,0 +1,1021 @@
+// guid_db.cpp - The compiled GUID database
+// License: MIT
+
+#include "guid.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+
+#if defined(_WIN32) && !defined(_WON32)
+    #define GUID_MAP_WIN32
+#elif defined(__unix__) || defined(__APPLE__)
+    #define GUID_MAP_POSIX
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline size_t guid_db_align(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+static int guid_compare(const GUID& guid1, const GUID& guid2)
+{
+    return memcmp(&guid1, &guid2, sizeof(GUID));
+}
+
+// NOTE: The hash values are stored in compiled files. Don't change this without
+//       incrementing GUID_DB_VERSION.
+static inline uint32_t guid_hash(const GUID& guid)
+{
+    uint64_t lo, hi;
+    memcpy(&lo, &guid, sizeof(lo));
+    memcpy(&hi, (const uint8_t *)&guid + sizeof(lo), sizeof(hi));
+    uint64_t h = lo ^ (hi * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 32;
+    return (uint32_t)h;
+}
+
+// Names are compared case-insensitively in ASCII. Other bytes of UTF-8 are kept as they are
+static inline char guid_ascii_upper(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') ? (char)(ch - 'a' + 'A') : ch;
+}
+
+static uint32_t guid_db_hash_size(uint32_t count)
+{
+    // Keep the load factor at most 50%
+    uint32_t size = 16;
+    while (size < count * 2)
+        size *= 2;
+    return size;
+}
+
+// The upper-cased text forms of an entry that guid_search_by_text looks into
+static void guid_db_get_texts(std::string texts[4], const GUID& guid, const char *name)
+{
+    char buf[GUID_STRUCT_TEXT_LENGTH + 1];
+
+    texts[0].resize(guid_format_definition(&texts[0][0], 0, guid, name));
+    guid_format_definition(&texts[0][0], texts[0].size() + 1, guid, name);
+    texts[1].assign(buf, guid_format_guid_text(buf, guid));
+    texts[2].assign(buf, guid_format_struct_text(buf, guid));
+    texts[3].assign(buf, guid_format_hex_text(buf, guid));
+
+    for (int i = 0; i < 4; ++i)
+    {
+        for (auto& ch : texts[i])
+            ch = guid_ascii_upper(ch);
+    }
+}
+
+static inline uint32_t guid_trigram_key(const char *pch)
+{
+    return ((uint8_t)pch[0] << 16) | ((uint8_t)pch[1] << 8) | (uint8_t)pch[2];
+}
+
+static void guid_db_put_varint(std::string& postings, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        postings += (char)(value | 0x80);
+        value >>= 7;
+    }
+    postings += (char)value;
+}
+
+static bool guid_db_get_varint(const GUID_DB& db, uint32_t& offset, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 32 && offset < db.postings_size; shift += 7)
+    {
+        uint8_t byte = db.postings[offset++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool guid_db_build(std::vector<uint8_t>& image, const GUID_DATA *data, bool text_index)
+{
+    image.clear();
+    if (!data)
+        return false;
+
+    const uint32_t count = (uint32_t)data->size();
+
+    // Intern the names in the order of the source
+    std::string names;
+    std::vector<uint32_t> name_offsets(count);
+    std::vector<uint32_t> name_lengths(count);
+    std::unordered_map<std::string, uint32_t> interned;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const std::string& name = (*data)[i].name;
+        auto it = interned.find(name);
+        if (it == interned.end())
+        {
+            it = interned.insert({ name, (uint32_t)names.size() }).first;
+            names += name;
+            names += '\0';
+        }
+        name_offsets[i] = it->second;
+        name_lengths[i] = (uint32_t)name.size();
+    }
+
+    // Sort by GUID. Entries of the same GUID keep the order of the source
+    std::vector<uint32_t> sorted(count);
+    for (uint32_t i = 0; i < count; ++i)
+        sorted[i] = i;
+    std::stable_sort(sorted.begin(), sorted.end(), [&](uint32_t x, uint32_t y) {
+        return guid_compare((*data)[x].guid, (*data)[y].guid) < 0;
+    });
+
+    // Collect the trigrams of each entry in the order of the source
+    std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+    std::vector<uint32_t> keys;
+    std::string texts[4];
+    for (uint32_t i = 0; text_index && i < count; ++i)
+    {
+        guid_db_get_texts(texts, (*data)[i].guid, &names[name_offsets[i]]);
+
+        keys.clear();
+        for (auto& text : texts)
+        {
+            for (size_t ich = 0; ich + 3 <= text.size(); ++ich)
+                keys.push_back(guid_trigram_key(&text[ich]));
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        for (auto key : keys)
+            lists[key].push_back(i);
+    }
+
+    // A trigram in more than 1/8 of the entries hardly narrows down a search
+    const size_t max_list = std::max<size_t>(count / 8, 16);
+    std::vector<GUID_DB_TRIGRAM> trigrams;
+    std::string postings;
+    for (auto& pair : lists)
+        trigrams.push_back({ pair.first, 0, 0 });
+    std::sort(trigrams.begin(), trigrams.end(), [](const GUID_DB_TRIGRAM& x, const GUID_DB_TRIGRAM& y) {
+        return x.key < y.key;
+    });
+    for (auto& trigram : trigrams)
+    {
+        auto& list = lists[trigram.key];
+        trigram.offset = (uint32_t)postings.size();
+        if (list.size() > max_list)
+            continue;
+
+        trigram.count = (uint32_t)list.size();
+        uint32_t prev = 0;
+        for (auto pos : list)
+        {
+            guid_db_put_varint(postings, pos - prev);
+            prev = pos;
+        }
+    }
+
+    GUID_DB_HEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GUID_DB_MAGIC, sizeof(GUID_DB_MAGIC));
+    header.version = GUID_DB_VERSION;
+    header.count = count;
+
+    size_t offset = guid_db_align(sizeof(header));
+    header.records_offset = (uint32_t)offset;
+    offset = guid_db_align(offset + count * sizeof(GUID_DB_RECORD));
+    header.order_offset = (uint32_t)offset;
+    offset = guid_db_align(offset + count * sizeof(uint32_t));
+    header.names_offset = (uint32_t)offset;
+    header.names_size = (uint32_t)names.size();
+    offset = guid_db_align(offset + names.size());
+    header.hash_offset = (uint32_t)offset;
+    header.hash_size = guid_db_hash_size(count);
+    offset = guid_db_align(offset + header.hash_size * sizeof(uint32_t));
+    header.folded_offset = (uint32_t)offset;
+    offset = guid_db_align(offset + names.size());
+    header.by_name_offset = (uint32_t)offset;
+    offset = guid_db_align(offset + count * sizeof(uint32_t));
+    header.trigrams_offset = (uint32_t)offset;
+    header.trigram_count = (uint32_t)trigrams.size();
+    offset = guid_db_align(offset + trigrams.size() * sizeof(GUID_DB_TRIGRAM));
+    header.postings_offset = (uint32_t)offset;
+    header.postings_size = (uint32_t)postings.size();
+    offset += postings.size();
+
+    if (offset > UINT32_MAX)
+        return false;
+
+    image.assign(offset, 0);
+    memcpy(&image[0], &header, sizeof(header));
+
+    GUID_DB_RECORD *records = (GUID_DB_RECORD *)&image[header.records_offset];
+    uint32_t *order = (uint32_t *)&image[header.order_offset];
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t k = sorted[i];
+        records[i].guid = (*data)[k].guid;
+        records[i].name_offset = name_offsets[k];
+        records[i].name_length = name_lengths[k];
+        order[k] = i;
+    }
+
+    if (names.size())
+        memcpy(&image[header.names_offset], names.data(), names.size());
+
+    // Index the first record of each GUID by linear probing
+    uint32_t *hash = (uint32_t *)&image[header.hash_offset];
+    const uint32_t mask = header.hash_size - 1;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (i > 0 && guid_equal(records[i - 1].guid, records[i].guid))
+            continue;
+
+        uint32_t slot = guid_hash(records[i].guid) & mask;
+        while (hash[slot])
+            slot = (slot + 1) & mask;
+        hash[slot] = i + 1;
+    }
+
+    char *folded = (char *)&image[header.folded_offset];
+    for (size_t ich = 0; ich < names.size(); ++ich)
+        folded[ich] = guid_ascii_upper(names[ich]);
+
+    // Sort by folded name. Entries of the same folded name keep the order of the source
+    uint32_t *by_name = (uint32_t *)&image[header.by_name_offset];
+    for (uint32_t i = 0; i < count; ++i)
+        by_name[i] = order[i];
+    std::stable_sort(by_name, by_name + count, [&](uint32_t x, uint32_t y) {
+        return strcmp(&folded[records[x].name_offset], &folded[records[y].name_offset]) < 0;
+    });
+
+    if (trigrams.size())
+        memcpy(&image[header.trigrams_offset], trigrams.data(), trigrams.size() * sizeof(GUID_DB_TRIGRAM));
+    if (postings.size())
+        memcpy(&image[header.postings_offset], postings.data(), postings.size());
+
+    return true;
+}
+
+bool guid_db_attach(GUID_DB& db, const void *image, size_t size)
+{
+    memset(&db, 0, sizeof(db));
+
+    if (!image || size < sizeof(GUID_DB_HEADER))
+        return false;
+
+    const uint8_t *pb = (const uint8_t *)image;
+    const GUID_DB_HEADER *header = (const GUID_DB_HEADER *)pb;
+    if (memcmp(header->magic, GUID_DB_MAGIC, sizeof(GUID_DB_MAGIC)) != 0 ||
+        header->version != GUID_DB_VERSION)
+    {
+        return false;
+    }
+
+    const size_t count = header->count;
+    if (header->records_offset % 8 || header->order_offset % 4 ||
+        header->records_offset > size || (size - header->records_offset) / sizeof(GUID_DB_RECORD) < count ||
+        header->order_offset > size || (size - header->order_offset) / sizeof(uint32_t) < count ||
+        header->names_offset > size || size - header->names_offset < header->names_size ||
+        header->hash_offset % 4 || header->hash_size < count || (header->hash_size & (header->hash_size - 1)) ||
+        header->hash_offset > size || (size - header->hash_offset) / sizeof(uint32_t) < header->hash_size ||
+        header->folded_offset > size || size - header->folded_offset < header->names_size ||
+        header->by_name_offset % 4 ||
+        header->by_name_offset > size || (size - header->by_name_offset) / sizeof(uint32_t) < count ||
+        header->trigrams_offset % 4 || header->trigrams_offset > size ||
+        (size - header->trigrams_offset) / sizeof(GUID_DB_TRIGRAM) < header->trigram_count ||
+        header->postings_offset > size || size - header->postings_offset < header->postings_size)
+    {
+        return false;
+    }
+
+    const GUID_DB_RECORD *records = (const GUID_DB_RECORD *)&pb[header->records_offset];
+    const uint32_t *order = (const uint32_t *)&pb[header->order_offset];
+    const char *names = (const char *)&pb[header->names_offset];
+    const uint32_t *hash = (const uint32_t *)&pb[header->hash_offset];
+    const char *folded = (const char *)&pb[header->folded_offset];
+    const uint32_t *by_name = (const uint32_t *)&pb[header->by_name_offset];
+    const GUID_DB_TRIGRAM *trigrams = (const GUID_DB_TRIGRAM *)&pb[header->trigrams_offset];
+
+    // Every name must be inside of the pool and NUL-terminated
+    for (size_t i = 0; i < count; ++i)
+    {
+        const GUID_DB_RECORD& record = records[i];
+        if (record.name_offset >= header->names_size ||
+            header->names_size - record.name_offset <= record.name_length ||
+            names[record.name_offset + record.name_length] != 0 ||
+            folded[record.name_offset + record.name_length] != 0 ||
+            order[i] >= count || by_name[i] >= count)
+        {
+            return false;
+        }
+    }
+
+    // At least one empty slot is needed to stop probing
+    uint32_t empty_slots = 0;
+    for (size_t i = 0; i < header->hash_size; ++i)
+    {
+        if (hash[i] > count)
+            return false;
+        if (!hash[i])
+            ++empty_slots;
+    }
+    if (!empty_slots)
+        return false;
+
+    for (size_t i = 0; i < header->trigram_count; ++i)
+    {
+        if (trigrams[i].offset > header->postings_size || (i > 0 && trigrams[i - 1].key >= trigrams[i].key))
+            return false;
+    }
+
+    db.records = records;
+    db.order = order;
+    db.names = names;
+    db.hash = hash;
+    db.folded = folded;
+    db.by_name = by_name;
+    db.trigrams = trigrams;
+    db.postings = &pb[header->postings_offset];
+    db.count = header->count;
+    db.names_size = header->names_size;
+    db.hash_size = header->hash_size;
+    db.trigram_count = header->trigram_count;
+    db.postings_size = header->postings_size;
+    db.source_size = header->source_size;
+    db.source_mtime = header->source_mtime;
+    return true;
+}
+
+void guid_db_get_entry(GUID_ENTRY& entry, const GUID_DB& db, uint32_t index)
+{
+    const GUID_DB_RECORD& record = db.records[index];
+    entry.name.assign(&db.names[record.name_offset], record.name_length);
+    entry.guid = record.guid;
+}
+
+GUID_DATA* guid_db_decode(const GUID_DB& db)
+{
+    GUID_DATA *entries = new GUID_DATA(db.count);
+    for (uint32_t i = 0; i < db.count; ++i)
+        guid_db_get_entry((*entries)[i], db, db.order[i]);
+    return entries;
+}
+
+uint32_t guid_db_find(const GUID_DB& db, const GUID& guid)
+{
+    if (!db.hash_size)
+        return GUID_DB_NOT_FOUND;
+
+    const uint32_t mask = db.hash_size - 1;
+    for (uint32_t slot = guid_hash(guid) & mask;; slot = (slot + 1) & mask)
+    {
+        uint32_t value = db.hash[slot];
+        if (!value)
+            return GUID_DB_NOT_FOUND;
+        if (guid_equal(db.records[value - 1].guid, guid))
+            return value - 1;
+    }
+}
+
+bool guid_db_search_by_guid(GUID_FOUND& found, const GUID_DB& db, const GUID& guid)
+{
+    // The records of the same GUID are adjacent
+    uint32_t index = guid_db_find(db, guid);
+    if (index != GUID_DB_NOT_FOUND)
+    {
+        for (; index < db.count && guid_equal(db.records[index].guid, guid); ++index)
+        {
+            GUID_ENTRY entry;
+            guid_db_get_entry(entry, db, index);
+            found.push_back(entry);
+        }
+    }
+    return !found.empty();
+}
+
+// Compares a folded name with a name to be folded, in the same order as strcmp
+static int guid_folded_compare(const char *folded, const char *name)
+{
+    for (;; ++folded, ++name)
+    {
+        char ch = guid_ascii_upper(*name);
+        if (*folded != ch)
+            return ((uint8_t)*folded < (uint8_t)ch) ? -1 : +1;
+        if (!ch)
+            return 0;
+    }
+}
+
+uint32_t guid_db_find_name(const GUID_DB& db, const char *name)
+{
+    // The first one of the same folded name is the earliest in the source
+    auto end = db.by_name + db.count;
+    auto it = std::lower_bound(db.by_name, end, name, [&](uint32_t index, const char *name) {
+        return guid_folded_compare(&db.folded[db.records[index].name_offset], name) < 0;
+    });
+    if (it == end || guid_folded_compare(&db.folded[db.records[*it].name_offset], name) != 0)
+        return GUID_DB_NOT_FOUND;
+
+    return *it;
+}
+
+bool guid_db_search_by_name(GUID_FOUND& found, const GUID_DB& db, const char *name)
+{
+    uint32_t index = guid_db_find_name(db, name);
+    if (index == GUID_DB_NOT_FOUND)
+        return false;
+
+    GUID_ENTRY entry;
+    guid_db_get_entry(entry, db, index);
+    found.push_back(entry);
+    return true;
+}
+
+bool guid_db_search_by_name(GUID_FOUND& found, const GUID_DB& db, const wchar_t *name)
+{
+    return guid_db_search_by_name(found, db, guid_ansi_from_wide(name, CP_UTF8).c_str());
+}
+
+static bool guid_db_get_postings(std::vector<uint32_t>& positions, const GUID_DB& db,
+                                 const GUID_DB_TRIGRAM& trigram)
+{
+    positions.resize(trigram.count);
+    uint32_t offset = trigram.offset, pos = 0, delta;
+    for (auto& position : positions)
+    {
+        if (!guid_db_get_varint(db, offset, delta))
+            return false;
+        pos += delta;
+        if (pos >= db.count)
+            return false;
+        position = pos;
+    }
+    return true;
+}
+
+bool guid_db_search_by_text(GUID_FOUND& found, const GUID_DB& db, const char *text)
+{
+    std::string str = text;
+    for (auto& ch : str)
+        ch = guid_ascii_upper(ch);
+
+    // Find the candidates by intersecting the posting lists of the trigrams in the query.
+    // If no trigram can narrow down, every entry is a candidate.
+    std::vector<const GUID_DB_TRIGRAM *> lists;
+    for (size_t ich = 0; db.trigram_count && ich + 3 <= str.size(); ++ich)
+    {
+        uint32_t key = guid_trigram_key(&str[ich]);
+        auto end = db.trigrams + db.trigram_count;
+        auto it = std::lower_bound(db.trigrams, end, key, [](const GUID_DB_TRIGRAM& trigram, uint32_t key) {
+            return trigram.key < key;
+        });
+        if (it == end || it->key != key)
+            return !found.empty(); // No entry has it
+        if (it->count)
+            lists.push_back(it);
+    }
+    std::sort(lists.begin(), lists.end(), [](const GUID_DB_TRIGRAM *x, const GUID_DB_TRIGRAM *y) {
+        return x->count < y->count;
+    });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+    std::vector<uint32_t> candidates, positions, common;
+    if (lists.empty())
+    {
+        candidates.resize(db.count);
+        for (uint32_t i = 0; i < db.count; ++i)
+            candidates[i] = i;
+    }
+    else
+    {
+        if (!guid_db_get_postings(candidates, db, *lists[0]))
+            return !found.empty();
+
+        for (size_t i = 1; i < lists.size() && candidates.size(); ++i)
+        {
+            if (!guid_db_get_postings(positions, db, *lists[i]))
+                return !found.empty();
+            common.clear();
+            std::set_intersection(candidates.begin(), candidates.end(),
+                                  positions.begin(), positions.end(), std::back_inserter(common));
+            candidates.swap(common);
+        }
+    }
+
+    // Verify the candidates
+    std::string texts[4];
+    for (auto pos : candidates)
+    {
+        uint32_t index = db.order[pos];
+        const GUID_DB_RECORD& record = db.records[index];
+        guid_db_get_texts(texts, record.guid, &db.names[record.name_offset]);
+        for (auto& text : texts)
+        {
+            if (text.find(str) != text.npos)
+            {
+                GUID_ENTRY entry;
+                guid_db_get_entry(entry, db, index);
+                found.push_back(entry);
+                break;
+            }
+        }
+    }
+
+    return !found.empty();
+}
+
+bool guid_db_search_by_text(GUID_FOUND& found, const GUID_DB& db, const wchar_t *text)
+{
+    return guid_db_search_by_text(found, db, guid_ansi_from_wide(text, CP_UTF8).c_str());
+}
+
+static bool guid_file_stamp(const char *fname, uint64_t& size, int64_t& mtime)
+{
+#ifdef GUID_MAP_WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(fname, GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return false;
+    }
+    size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    mtime = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+                      data.ftLastWriteTime.dwLowDateTime);
+    return true;
+#elif defined(GUID_MAP_POSIX)
+    struct stat st;
+    if (stat(fname, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool guid_db_is_stale(const GUID_DB& db, const char *data_file)
+{
+    uint64_t size;
+    int64_t mtime;
+    if (!guid_file_stamp(data_file, size, mtime))
+        return false;
+    return size != db.source_size || mtime != db.source_mtime;
+}
+
+bool guid_compile_data_a(const char *data_file, const char *db_file)
+{
+    // Stamped before loading, so that a change while compiling makes it stale
+    GUID_DB_HEADER stamp;
+    memset(&stamp, 0, sizeof(stamp));
+    guid_file_stamp(data_file, stamp.source_size, stamp.source_mtime);
+
+    GUID_DATA *data = guid_load_data_a(data_file);
+    if (!data)
+        return false;
+
+    std::vector<uint8_t> image;
+    bool ok = guid_db_build(image, data);
+    guid_close_data(data);
+    if (!ok)
+        return false;
+
+    GUID_DB_HEADER *header = (GUID_DB_HEADER *)image.data();
+    header->source_size = stamp.source_size;
+    header->source_mtime = stamp.source_mtime;
+
+    FILE *fp = fopen(db_file, "wb");
+    if (!fp)
+        return false;
+
+    ok = (fwrite(image.data(), image.size(), 1, fp) == 1);
+    if (fclose(fp) != 0)
+        ok = false;
+    return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory mapping
+
+#ifdef GUID_MAP_WIN32
+static const void *guid_map_handle(HANDLE hFile, size_t *psize)
+{
+    LARGE_INTEGER li;
+    if (!::GetFileSizeEx(hFile, &li) || li.QuadPart <= 0 || (ULONGLONG)li.QuadPart > (SIZE_T)-1)
+    {
+        ::CloseHandle(hFile);
+        return NULL;
+    }
+
+    HANDLE hMapping = ::CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    ::CloseHandle(hFile);
+    if (!hMapping)
+        return NULL;
+
+    // The view keeps the mapping alive
+    const void *ptr = ::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle(hMapping);
+    if (!ptr)
+        return NULL;
+
+    *psize = (size_t)li.QuadPart;
+    return ptr;
+}
+
+const void *guid_map_file_a(const char *fname, size_t *psize)
+{
+    HANDLE hFile = ::CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
+    return guid_map_handle(hFile, psize);
+}
+
+const void *guid_map_file_w(const wchar_t *fname, size_t *psize)
+{
+    HANDLE hFile = ::CreateFileW(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
+    return guid_map_handle(hFile, psize);
+}
+
+void guid_unmap_file(const void *ptr, size_t size)
+{
+    if (ptr)
+        ::UnmapViewOfFile(ptr);
+}
+#elif defined(GUID_MAP_POSIX)
+const void *guid_map_file_a(const char *fname, size_t *psize)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    {
+        ::close(fd);
+        return NULL;
+    }
+
+    void *ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    *psize = (size_t)st.st_size;
+    return ptr;
+}
+
+void guid_unmap_file(const void *ptr, size_t size)
+{
+    if (ptr)
+        munmap(const_cast<void *>(ptr), size);
+}
+#else
+// No mapping available; read the whole file into memory
+const void *guid_map_file_a(const char *fname, size_t *psize)
+{
+    FILE *fp = fopen(fname, "rb");
+    if (!fp)
+        return NULL;
+
+    long size = -1;
+    if (fseek(fp, 0, SEEK_END) == 0)
+        size = ftell(fp);
+    if (size <= 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    void *ptr = malloc((size_t)size);
+    if (ptr && fread(ptr, (size_t)size, 1, fp) != 1)
+    {
+        free(ptr);
+        ptr = NULL;
+    }
+    fclose(fp);
+
+    if (ptr)
+        *psize = (size_t)size;
+    return ptr;
+}
+
+void guid_unmap_file(const void *ptr, size_t size)
+{
+    free(const_cast<void *>(ptr));
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Scanning binary data
+//
+// Every byte offset may begin a GUID. A bitmap of hashes of the GUIDs in the database, small
+// enough to stay in the cache, rejects almost all the offsets before guid_db_find.
+
+#define GUID_DB_FILTER_BITS     19                      // 64 KB
+#define GUID_DB_SCAN_CHUNK      ((size_t)1024 * 1024)   // for a stream
+#define GUID_DB_SCAN_RANGE      ((size_t)16 * 1024 * 1024) // for a thread at a time
+
+static inline uint32_t guid_filter_hash(uint64_t lo, uint64_t hi)
+{
+    uint64_t h = (lo ^ (hi * 0x9E3779B97F4A7C15ULL)) * 0xD6E8FEB86659FD93ULL;
+    return (uint32_t)(h >> (64 - GUID_DB_FILTER_BITS));
+}
+
+void guid_db_build_filter(std::vector<uint64_t>& filter, const GUID_DB& db)
+{
+    filter.assign((1 << GUID_DB_FILTER_BITS) / 64, 0);
+
+    // GUID_NULL is not for binary data, as zeros are everywhere
+    for (uint32_t i = 0; i < db.count; ++i)
+    {
+        uint64_t lo, hi;
+        memcpy(&lo, &db.records[i].guid, sizeof(lo));
+        memcpy(&hi, (const uint8_t *)&db.records[i].guid + sizeof(lo), sizeof(hi));
+        if (!lo && !hi)
+            continue;
+        uint32_t h = guid_filter_hash(lo, hi);
+        filter[h >> 6] |= 1ULL << (h & 63);
+    }
+}
+
+struct GUID_DB_SCANNER
+{
+    const GUID_DB& db;
+    GUID_FOUND& found;
+    const uint64_t *bits;
+    std::vector<bool> seen;     // the GUIDs already found, by the first record index
+
+    GUID_DB_SCANNER(const GUID_DB& db_, GUID_FOUND& found_, const uint64_t *filter)
+        : db(db_), found(found_), bits(filter), seen(db_.count)
+    {
+    }
+
+    // The GUIDs beginning at pb[0..size), which has 15 more bytes to read
+    void scan(const uint8_t *pb, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            uint64_t lo, hi;
+            memcpy(&lo, pb + i, sizeof(lo));
+            memcpy(&hi, pb + i + sizeof(lo), sizeof(hi));
+            uint32_t h = guid_filter_hash(lo, hi);
+            if ((bits[h >> 6] & (1ULL << (h & 63))) && (lo || hi))
+                add(pb + i);
+        }
+    }
+
+    void add(const uint8_t *pb)
+    {
+        GUID guid;
+        memcpy(&guid, pb, sizeof(guid));
+        uint32_t index = guid_db_find(db, guid);
+        if (index == GUID_DB_NOT_FOUND || seen[index])
+            return;
+
+        seen[index] = true;
+        for (; index < db.count && guid_equal(db.records[index].guid, guid); ++index)
+        {
+            GUID_ENTRY entry;
+            guid_db_get_entry(entry, db, index);
+            found.push_back(entry);
+        }
+    }
+};
+
+bool guid_db_scan_binary(GUID_FOUND& found, const GUID_DB& db, const void *ptr, size_t size,
+                         int threads, const uint64_t *filter)
+{
+    std::vector<uint64_t> bits;
+    if (!filter)
+    {
+        guid_db_build_filter(bits, db);
+        filter = bits.data();
+    }
+
+    const uint8_t *pb = (const uint8_t *)ptr;
+    size_t count = (size >= sizeof(GUID)) ? size - (sizeof(GUID) - 1) : 0;
+    size_t ranges = (count + GUID_DB_SCAN_RANGE - 1) / GUID_DB_SCAN_RANGE;
+    if (threads > 1 && ranges > 1)
+    {
+        // Each thread takes the next range with a scanner of its own. The lists are merged
+        // and sorted, so that the result is the same as with a thread
+        threads = (int)std::min((size_t)threads, ranges);
+        std::vector<GUID_FOUND> lists(threads);
+        std::atomic<size_t> next(0);
+        auto worker = [&](int index) {
+            GUID_DB_SCANNER scanner(db, lists[index], filter);
+            for (size_t i; (i = next++) < ranges; )
+            {
+                size_t offset = i * GUID_DB_SCAN_RANGE;
+                scanner.scan(pb + offset, std::min(count - offset, GUID_DB_SCAN_RANGE));
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; ++i)
+            pool.emplace_back(worker, i);
+        worker(0);
+        for (auto& thread : pool)
+            thread.join();
+
+        for (auto& list : lists)
+            found.insert(found.end(), list.begin(), list.end());
+    }
+    else if (count)
+    {
+        GUID_DB_SCANNER scanner(db, found, filter);
+        scanner.scan(pb, count);
+    }
+
+    guid_sort_and_unique(found);
+    return !found.empty();
+}
+
+bool guid_db_scan_binary_fp(GUID_FOUND& found, const GUID_DB& db, FILE *fp, const uint64_t *filter)
+{
+    std::vector<uint64_t> bits;
+    if (!filter)
+    {
+        guid_db_build_filter(bits, db);
+        filter = bits.data();
+    }
+
+    // The last 15 bytes of a chunk are carried over to the next
+    GUID_DB_SCANNER scanner(db, found, filter);
+    std::vector<uint8_t> buffer(GUID_DB_SCAN_CHUNK);
+    size_t size = 0;
+    for (;;)
+    {
+        size_t cb = fread(&buffer[size], 1, buffer.size() - size, fp);
+        if (!cb)
+            break;
+        size += cb;
+        if (size < sizeof(GUID))
+            continue;
+
+        size_t count = size - (sizeof(GUID) - 1);
+        scanner.scan(buffer.data(), count);
+        memmove(buffer.data(), &buffer[count], size - count);
+        size -= count;
+    }
+
+    guid_sort_and_unique(found);
+    return !found.empty();
+}
+
+bool guid_db_scan_binary_file_a(GUID_FOUND& found, const GUID_DB& db, const char *fname,
+                                int threads, const uint64_t *filter)
+{
+#if defined(GUID_MAP_WIN32) || defined(GUID_MAP_POSIX)
+    size_t size;
+    if (const void *ptr = guid_map_file_a(fname, &size))
+    {
+        bool ret = guid_db_scan_binary(found, db, ptr, size, threads, filter);
+        guid_unmap_file(ptr, size);
+        return ret;
+    }
+#endif
+
+    FILE *fp = fopen(fname, "rb");
+    if (!fp)
+        return false;
+
+    bool ret = guid_db_scan_binary_fp(found, db, fp, filter);
+    fclose(fp);
+    return ret;
+}
+
+#ifdef GUID_MAP_WIN32
+bool guid_db_scan_binary_file_w(GUID_FOUND& found, const GUID_DB& db, const wchar_t *fname,
+                                int threads, const uint64_t *filter)
+{
+    size_t size;
+    if (const void *ptr = guid_map_file_w(fname, &size))
+    {
+        bool ret = guid_db_scan_binary(found, db, ptr, size, threads, filter);
+        guid_unmap_file(ptr, size);
+        return ret;
+    }
+
+    FILE *fp = _wfopen(fname, L"rb");
+    if (!fp)
+        return false;
+
+    bool ret = guid_db_scan_binary_fp(found, db, fp, filter);
+    fclose(fp);
+    return ret;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// GuidDataBase
+
+bool GuidDataBase::attach_view(const void *view, size_t size)
+{
+    if (!guid_db_attach(m_db, view, size))
+    {
+        guid_unmap_file(view, size);
+        return false;
+    }
+
+    m_view = view;
+    m_view_size = size;
+    return true;
+}
+
+bool GuidDataBase::attach_data(GUID_DATA *data)
+{
+    if (!data)
+        return false;
+
+    m_data = data;
+    // Building the text index costs more than a few searches. Compile the file to have it
+    return guid_db_build(m_image, m_data, false) && guid_db_attach(m_db, m_image.data(), m_image.size());
+}
+
+bool GuidDataBase::load(const char *filename)
+{
+    close();
+
+    // A compiled file is mapped as is. Otherwise, it's a text file
+    size_t size;
+    const void *view = guid_map_file_a(filename, &size);
+    if (!view || !attach_view(view, size))
+        attach_data(guid_load_data_a(filename));
+
+    return is_loaded();
+}
+
+bool GuidDataBase::load(const wchar_t *filename)
+{
+#if defined(_WIN32) && !defined(_WON32)
+    close();
+
+    size_t size;
+    const void *view = guid_map_file_w(filename, &size);
+    if (!view || !attach_view(view, size))
+        attach_data(guid_load_data_w(filename));
+
+    return is_loaded();
+#else
+    return load(guid_ansi_from_wide(filename).c_str());
+#endif
+}
+
+#ifdef RGUID_EMBED_DATABASE
+bool GuidDataBase::load_embedded()
+{
+    close();
+    m_db = guid_db_embedded();
+    return is_loaded();
+}
+#endif
+
+void GuidDataBase::close()
+{
+    if (m_view)
+    {
+        guid_unmap_file(m_view, m_view_size);
+        m_view = NULL;
+        m_view_size = 0;
+    }
+    if (m_data)
+    {
+        guid_close_data(m_data);
+        m_data = NULL;
+    }
+    m_image.clear();
+    m_filter.clear();
+    memset(&m_db, 0, sizeof(m_db));
+}
+
+// Built once for all the scans, which may be on many threads
+const uint64_t *GuidDataBase::filter()
+{
+    std::lock_guard<std::mutex> lock(m_filter_mutex);
+    if (m_filter.empty())
+        guid_db_build_filter(m_filter, m_db);
+    return m_filter.data();
+}
@@ -0,0 +1,155 @@
+// guid_embed.cpp --- Generates the built-in database from guid.dat
+// License: MIT
+//
+// Usage: guid_embed guid.dat guid_embedded.cpp
+//
+// The output defines guid_db_embedded() with constexpr tables in the same layout as the
+// compiled database (see GUID_DB), so that RGUID_EMBED_DATABASE needs no file and no heap.
+
+#include "guid.h"
+#include <cstdio>
+
+static void emit_bytes(FILE *fp, const char *name, const uint8_t *pb, size_t size)
+{
+    fprintf(fp, "static constexpr uint8_t %s[] =\n{", name);
+    if (!size)
+        fprintf(fp, "\n    0,");
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (i % 20 == 0)
+            fprintf(fp, "\n    ");
+        fprintf(fp, "%u,", pb[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+}
+
+// Character literals, as the signedness of char varies
+static void emit_chars(FILE *fp, const char *name, const char *pch, size_t size)
+{
+    fprintf(fp, "static constexpr char %s[] =\n{", name);
+    if (!size)
+        fprintf(fp, "\n    0,");
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (i % 16 == 0)
+            fprintf(fp, "\n    ");
+        fprintf(fp, "'\\x%02X',", (uint8_t)pch[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+}
+
+static void emit_uint32s(FILE *fp, const char *name, const uint32_t *values, size_t count)
+{
+    fprintf(fp, "static constexpr uint32_t %s[] =\n{", name);
+    if (!count)
+        fprintf(fp, "\n    0,");
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i % 10 == 0)
+            fprintf(fp, "\n    ");
+        fprintf(fp, "%u,", values[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+}
+
+static bool emit_db(FILE *fp, const GUID_DB& db)
+{
+    fprintf(fp,
+        "// guid_embedded.cpp --- The built-in database generated by guid_embed. DO NOT EDIT.\n"
+        "\n"
+        "#include \"guid.h\"\n"
+        "\n");
+
+    // Records sorted by GUID
+    fprintf(fp, "static constexpr GUID_DB_RECORD s_records[] =\n{\n");
+    for (uint32_t i = 0; i < db.count; ++i)
+    {
+        const GUID_DB_RECORD& record = db.records[i];
+        const GUID& guid = record.guid;
+        fprintf(fp,
+            "    { { 0x%08X, 0x%04X, 0x%04X, { 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X } }, %u, %u }, // %s\n",
+            guid.Data1, guid.Data2, guid.Data3,
+            guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+            guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+            record.name_offset, record.name_length, &db.names[record.name_offset]);
+    }
+    if (!db.count)
+        fprintf(fp, "    { { 0 }, 0, 0 },\n");
+    fprintf(fp, "};\n\n");
+
+    emit_uint32s(fp, "s_order", db.order, db.count);
+    emit_chars(fp, "s_names", db.names, db.names_size);
+    emit_uint32s(fp, "s_hash", db.hash, db.hash_size);
+    emit_chars(fp, "s_folded", db.folded, db.names_size);
+    emit_uint32s(fp, "s_by_name", db.by_name, db.count);
+
+    fprintf(fp, "static constexpr GUID_DB_TRIGRAM s_trigrams[] =\n{\n");
+    for (uint32_t i = 0; i < db.trigram_count; ++i)
+    {
+        const GUID_DB_TRIGRAM& trigram = db.trigrams[i];
+        fprintf(fp, "    { 0x%06X, %u, %u },\n", trigram.key, trigram.count, trigram.offset);
+    }
+    if (!db.trigram_count)
+        fprintf(fp, "    { 0, 0, 0 },\n");
+    fprintf(fp, "};\n\n");
+
+    emit_bytes(fp, "s_postings", db.postings, db.postings_size);
+
+    fprintf(fp,
+        "static constexpr GUID_DB s_db =\n"
+        "{\n"
+        "    s_records, s_order, s_names, s_hash, s_folded, s_by_name, s_trigrams, s_postings,\n"
+        "    %u, %u, %u, %u, %u, 0, 0\n"
+        "};\n"
+        "\n"
+        "const GUID_DB& guid_db_embedded(void)\n"
+        "{\n"
+        "    return s_db;\n"
+        "}\n",
+        db.count, db.names_size, db.hash_size, db.trigram_count, db.postings_size);
+
+    return !ferror(fp);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: guid_embed guid.dat guid_embedded.cpp\n");
+        return 1;
+    }
+
+    GUID_DATA *data = guid_load_data_a(argv[1]);
+    if (!data)
+    {
+        fprintf(stderr, "ERROR: Cannot load '%s'\n", argv[1]);
+        return 2;
+    }
+
+    std::vector<uint8_t> image;
+    GUID_DB db;
+    bool ok = guid_db_build(image, data) && guid_db_attach(db, image.data(), image.size());
+    guid_close_data(data);
+    if (!ok)
+    {
+        fprintf(stderr, "ERROR: Cannot build the database\n");
+        return 3;
+    }
+
+    FILE *fp = fopen(argv[2], "w");
+    if (!fp)
+    {
+        fprintf(stderr, "ERROR: Cannot write '%s'\n", argv[2]);
+        return 4;
+    }
+
+    ok = emit_db(fp, db);
+    if (fclose(fp) != 0 || !ok)
+    {
+        fprintf(stderr, "ERROR: Cannot write '%s'\n", argv[2]);
+        remove(argv[2]);
+        return 4;
+    }
+
+    return 0;
+}
@@ -0,0 +1,362 @@
+// guid_hash.cpp - Name-based GUIDs with SHA-1 (version 5) and MD5 (version 3)
+// License: MIT
+
+#include "guid.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GUID_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+// The namespaces of RFC 4122 Appendix C
+const GUID GUID_NAMESPACE_DNS = { 0x6BA7B810, 0x9DAD, 0x11D1, { 0x80, 0xB4, 0x00, 0xC0, 0x4F, 0xD4, 0x30, 0xC8 } };
+const GUID GUID_NAMESPACE_URL = { 0x6BA7B811, 0x9DAD, 0x11D1, { 0x80, 0xB4, 0x00, 0xC0, 0x4F, 0xD4, 0x30, 0xC8 } };
+const GUID GUID_NAMESPACE_OID = { 0x6BA7B812, 0x9DAD, 0x11D1, { 0x80, 0xB4, 0x00, 0xC0, 0x4F, 0xD4, 0x30, 0xC8 } };
+const GUID GUID_NAMESPACE_X500 = { 0x6BA7B814, 0x9DAD, 0x11D1, { 0x80, 0xB4, 0x00, 0xC0, 0x4F, 0xD4, 0x30, 0xC8 } };
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// The 32-bit lanes of the hash functions: one message in a uint32_t, or four in an __m128i
+
+template <typename T_LANE> static inline T_LANE guid_lane(uint32_t value);
+
+template <> inline uint32_t guid_lane<uint32_t>(uint32_t value)
+{
+    return value;
+}
+
+static inline uint32_t guid_lane_add(uint32_t a, uint32_t b) { return a + b; }
+static inline uint32_t guid_lane_and(uint32_t a, uint32_t b) { return a & b; }
+static inline uint32_t guid_lane_or(uint32_t a, uint32_t b) { return a | b; }
+static inline uint32_t guid_lane_xor(uint32_t a, uint32_t b) { return a ^ b; }
+static inline uint32_t guid_lane_andnot(uint32_t a, uint32_t b) { return ~a & b; }
+template <int N> static inline uint32_t guid_lane_rotl(uint32_t a) { return (a << N) | (a >> (32 - N)); }
+
+#ifdef GUID_USE_SSE2
+template <> inline __m128i guid_lane<__m128i>(uint32_t value)
+{
+    return _mm_set1_epi32((int)value);
+}
+
+static inline __m128i guid_lane_add(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+static inline __m128i guid_lane_and(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+static inline __m128i guid_lane_or(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+static inline __m128i guid_lane_xor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+static inline __m128i guid_lane_andnot(__m128i a, __m128i b) { return _mm_andnot_si128(a, b); }
+template <int N> static inline __m128i guid_lane_rotl(__m128i a)
+{
+    return _mm_or_si128(_mm_slli_epi32(a, N), _mm_srli_epi32(a, 32 - N));
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// SHA-1 and MD5 compression functions, on any lanes
+
+static const uint32_t s_sha1_init[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+static const uint32_t s_md5_init[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+
+static const uint32_t s_md5_k[64] =
+{
+    0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+    0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+    0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+    0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+    0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+    0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+    0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+    0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391,
+};
+
+// A step of SHA-1: e += (a <<< 5) + f(b, c, d) + k + w[i]; b <<<= 30. Five steps rotate the
+// roles of the variables back
+#define GUID_SHA1_STEP(a, b, c, d, e, f, i) \
+    e = guid_lane_add(guid_lane_add(e, guid_lane_rotl<5>(a)), \
+                      guid_lane_add(guid_lane_add(f(b, c, d), k), guid_sha1_schedule(w, i))); \
+    b = guid_lane_rotl<30>(b)
+
+#define GUID_SHA1_ROUND(f) \
+    for (int j = 0; j < 20; j += 5, i += 5) \
+    { \
+        GUID_SHA1_STEP(a, b, c, d, e, f, i + 0); \
+        GUID_SHA1_STEP(e, a, b, c, d, f, i + 1); \
+        GUID_SHA1_STEP(d, e, a, b, c, f, i + 2); \
+        GUID_SHA1_STEP(c, d, e, a, b, f, i + 3); \
+        GUID_SHA1_STEP(b, c, d, e, a, f, i + 4); \
+    }
+
+#define GUID_SHA1_CH(b, c, d) guid_lane_or(guid_lane_and(b, c), guid_lane_andnot(b, d))
+#define GUID_SHA1_PARITY(b, c, d) guid_lane_xor(guid_lane_xor(b, c), d)
+#define GUID_SHA1_MAJ(b, c, d) guid_lane_or(guid_lane_and(b, c), guid_lane_and(guid_lane_or(b, c), d))
+
+// The word i of the message schedule, computed as the steps go
+template <typename T_LANE>
+static inline T_LANE guid_sha1_schedule(T_LANE *w, int i)
+{
+    if (i >= 16)
+        w[i] = guid_lane_rotl<1>(guid_lane_xor(guid_lane_xor(w[i - 3], w[i - 8]), guid_lane_xor(w[i - 14], w[i - 16])));
+    return w[i];
+}
+
+// block is the 16 words of a block
+template <typename T_LANE>
+static inline void guid_sha1_compress(T_LANE *state, const T_LANE *block)
+{
+    T_LANE w[80];
+    for (int i = 0; i < 16; ++i)
+        w[i] = block[i];
+
+    T_LANE a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    T_LANE k;
+    int i = 0;
+    k = guid_lane<T_LANE>(0x5A827999);
+    GUID_SHA1_ROUND(GUID_SHA1_CH);
+    k = guid_lane<T_LANE>(0x6ED9EBA1);
+    GUID_SHA1_ROUND(GUID_SHA1_PARITY);
+    k = guid_lane<T_LANE>(0x8F1BBCDC);
+    GUID_SHA1_ROUND(GUID_SHA1_MAJ);
+    k = guid_lane<T_LANE>(0xCA62C1D6);
+    GUID_SHA1_ROUND(GUID_SHA1_PARITY);
+    state[0] = guid_lane_add(state[0], a);
+    state[1] = guid_lane_add(state[1], b);
+    state[2] = guid_lane_add(state[2], c);
+    state[3] = guid_lane_add(state[3], d);
+    state[4] = guid_lane_add(state[4], e);
+}
+
+// A step of MD5: a = b + ((a + f + k + w[g]) <<< s)
+#define GUID_MD5_STEP(a, b, c, d, f, i, g, s) \
+    a = guid_lane_add(b, guid_lane_rotl<s>(guid_lane_add(guid_lane_add(a, f), \
+                                                         guid_lane_add(guid_lane<T_LANE>(s_md5_k[i]), w[g]))))
+
+#define GUID_MD5_F(b, c, d) guid_lane_or(guid_lane_and(b, c), guid_lane_andnot(b, d))
+#define GUID_MD5_G(b, c, d) guid_lane_or(guid_lane_and(d, b), guid_lane_andnot(d, c))
+#define GUID_MD5_H(b, c, d) guid_lane_xor(guid_lane_xor(b, c), d)
+#define GUID_MD5_I(b, c, d) guid_lane_xor(c, guid_lane_or(b, guid_lane_xor(d, ones)))
+
+template <typename T_LANE>
+static inline void guid_md5_compress(T_LANE *state, const T_LANE *w)
+{
+    const T_LANE ones = guid_lane<T_LANE>(0xFFFFFFFF);
+    T_LANE a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 16; i += 4)
+    {
+        GUID_MD5_STEP(a, b, c, d, GUID_MD5_F(b, c, d), i + 0, i + 0, 7);
+        GUID_MD5_STEP(d, a, b, c, GUID_MD5_F(a, b, c), i + 1, i + 1, 12);
+        GUID_MD5_STEP(c, d, a, b, GUID_MD5_F(d, a, b), i + 2, i + 2, 17);
+        GUID_MD5_STEP(b, c, d, a, GUID_MD5_F(c, d, a), i + 3, i + 3, 22);
+    }
+    for (int i = 16; i < 32; i += 4)
+    {
+        GUID_MD5_STEP(a, b, c, d, GUID_MD5_G(b, c, d), i + 0, (5 * i + 1) & 15, 5);
+        GUID_MD5_STEP(d, a, b, c, GUID_MD5_G(a, b, c), i + 1, (5 * i + 6) & 15, 9);
+        GUID_MD5_STEP(c, d, a, b, GUID_MD5_G(d, a, b), i + 2, (5 * i + 11) & 15, 14);
+        GUID_MD5_STEP(b, c, d, a, GUID_MD5_G(c, d, a), i + 3, (5 * i + 16) & 15, 20);
+    }
+    for (int i = 32; i < 48; i += 4)
+    {
+        GUID_MD5_STEP(a, b, c, d, GUID_MD5_H(b, c, d), i + 0, (3 * i + 5) & 15, 4);
+        GUID_MD5_STEP(d, a, b, c, GUID_MD5_H(a, b, c), i + 1, (3 * i + 8) & 15, 11);
+        GUID_MD5_STEP(c, d, a, b, GUID_MD5_H(d, a, b), i + 2, (3 * i + 11) & 15, 16);
+        GUID_MD5_STEP(b, c, d, a, GUID_MD5_H(c, d, a), i + 3, (3 * i + 14) & 15, 23);
+    }
+    for (int i = 48; i < 64; i += 4)
+    {
+        GUID_MD5_STEP(a, b, c, d, GUID_MD5_I(b, c, d), i + 0, (7 * i) & 15, 6);
+        GUID_MD5_STEP(d, a, b, c, GUID_MD5_I(a, b, c), i + 1, (7 * i + 7) & 15, 10);
+        GUID_MD5_STEP(c, d, a, b, GUID_MD5_I(d, a, b), i + 2, (7 * i + 14) & 15, 15);
+        GUID_MD5_STEP(b, c, d, a, GUID_MD5_I(c, d, a), i + 3, (7 * i + 21) & 15, 21);
+    }
+    state[0] = guid_lane_add(state[0], a);
+    state[1] = guid_lane_add(state[1], b);
+    state[2] = guid_lane_add(state[2], c);
+    state[3] = guid_lane_add(state[3], d);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// The messages: the namespace in network byte order, then the name
+
+// The number of 64-byte blocks of a padded message
+static inline size_t guid_name_blocks(size_t cch)
+{
+    return (16 + cch + 8) / 64 + 1;
+}
+
+// Block index of the padded message into 16 words, big-endian (SHA-1) or little-endian (MD5)
+static void guid_name_block(uint32_t *words, const uint8_t *ns, const char *name, size_t cch,
+                            size_t index, bool big_endian)
+{
+    uint8_t block[64];
+    memset(block, 0, sizeof(block));
+
+    const size_t total = 16 + cch;
+    const size_t begin = index * 64, end = begin + 64;
+    if (begin < 16)
+        memcpy(block, ns, 16);
+    size_t lo = (begin > 16) ? begin : 16, hi = (end < total) ? end : total;
+    if (lo < hi)
+        memcpy(&block[lo - begin], &name[lo - 16], hi - lo);
+    if (begin <= total && total < end)
+        block[total - begin] = 0x80;
+    if (index + 1 == guid_name_blocks(cch))
+    {
+        uint64_t bits = (uint64_t)total * 8;
+        for (int i = 0; i < 8; ++i)
+            block[big_endian ? 63 - i : 56 + i] = (uint8_t)(bits >> (i * 8));
+    }
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const uint8_t *pb = &block[i * 4];
+        if (big_endian)
+            words[i] = ((uint32_t)pb[0] << 24) | (pb[1] << 16) | (pb[2] << 8) | pb[3];
+        else
+            words[i] = pb[0] | (pb[1] << 8) | (pb[2] << 16) | ((uint32_t)pb[3] << 24);
+    }
+}
+
+static void guid_to_bytes(uint8_t *bytes, const GUID& guid)
+{
+    bytes[0] = (uint8_t)(guid.Data1 >> 24);
+    bytes[1] = (uint8_t)(guid.Data1 >> 16);
+    bytes[2] = (uint8_t)(guid.Data1 >> 8);
+    bytes[3] = (uint8_t)guid.Data1;
+    bytes[4] = (uint8_t)(guid.Data2 >> 8);
+    bytes[5] = (uint8_t)guid.Data2;
+    bytes[6] = (uint8_t)(guid.Data3 >> 8);
+    bytes[7] = (uint8_t)guid.Data3;
+    memcpy(&bytes[8], guid.Data4, 8);
+}
+
+// The first 16 bytes of the hash (state) as a GUID of the version
+static void guid_from_hash(GUID& guid, const uint32_t *state, bool big_endian, int version)
+{
+    uint8_t bytes[16];
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int j = 0; j < 4; ++j)
+            bytes[i * 4 + j] = (uint8_t)(state[i] >> (big_endian ? 24 - j * 8 : j * 8));
+    }
+    bytes[6] = (uint8_t)((bytes[6] & 0x0F) | (version << 4));
+    bytes[8] = (uint8_t)((bytes[8] & 0x3F) | 0x80);
+
+    guid.Data1 = ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    guid.Data2 = (uint16_t)((bytes[4] << 8) | bytes[5]);
+    guid.Data3 = (uint16_t)((bytes[6] << 8) | bytes[7]);
+    memcpy(guid.Data4, &bytes[8], 8);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Version 5 (SHA-1) and version 3 (MD5)
+
+static void guid_generate_name1(GUID& guid, const uint8_t *ns, const char *name, size_t cch, bool sha1)
+{
+    uint32_t state[5], w[16];
+    memcpy(state, sha1 ? s_sha1_init : s_md5_init, sha1 ? sizeof(s_sha1_init) : sizeof(s_md5_init));
+
+    for (size_t index = 0; index < guid_name_blocks(cch); ++index)
+    {
+        guid_name_block(w, ns, name, cch, index, sha1);
+        if (sha1)
+            guid_sha1_compress(state, w);
+        else
+            guid_md5_compress(state, w);
+    }
+
+    guid_from_hash(guid, state, sha1, sha1 ? 5 : 3);
+}
+
+#ifdef GUID_USE_SSE2
+// Four messages at once, a lane per message. Lanes of shorter messages keep their states
+// once done
+static void guid_generate_name4(GUID *guids, const uint8_t *ns, const char *const *names,
+                                const size_t *lengths, bool sha1)
+{
+    __m128i state[5], w[16];
+    const int nState = sha1 ? 5 : 4;
+    for (int i = 0; i < 5; ++i)
+        state[i] = _mm_set1_epi32((int)(sha1 ? s_sha1_init[i] : (i < 4 ? s_md5_init[i] : 0)));
+
+    size_t blocks[4], max_blocks = 0;
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        blocks[lane] = guid_name_blocks(lengths[lane]);
+        if (max_blocks < blocks[lane])
+            max_blocks = blocks[lane];
+    }
+
+    uint32_t words[4][16];
+    for (size_t index = 0; index < max_blocks; ++index)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (index < blocks[lane])
+                guid_name_block(words[lane], ns, names[lane], lengths[lane], index, sha1);
+        }
+        for (int i = 0; i < 16; ++i)
+            w[i] = _mm_setr_epi32((int)words[0][i], (int)words[1][i], (int)words[2][i], (int)words[3][i]);
+
+        __m128i saved[5];
+        memcpy(saved, state, sizeof(saved));
+        if (sha1)
+            guid_sha1_compress(state, w);
+        else
+            guid_md5_compress(state, w);
+
+        if (index + 1 > blocks[0] || index + 1 > blocks[1] || index + 1 > blocks[2] || index + 1 > blocks[3])
+        {
+            __m128i active = _mm_setr_epi32(-(int)(index < blocks[0]), -(int)(index < blocks[1]),
+                                            -(int)(index < blocks[2]), -(int)(index < blocks[3]));
+            for (int i = 0; i < nState; ++i)
+                state[i] = _mm_or_si128(_mm_and_si128(active, state[i]), _mm_andnot_si128(active, saved[i]));
+        }
+    }
+
+    uint32_t lanes[5][4];
+    for (int i = 0; i < nState; ++i)
+        _mm_storeu_si128((__m128i *)lanes[i], state[i]);
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        uint32_t result[5];
+        for (int i = 0; i < nState; ++i)
+            result[i] = lanes[i][lane];
+        guid_from_hash(guids[lane], result, sha1, sha1 ? 5 : 3);
+    }
+}
+#endif
+
+static void guid_generate_names(GUID *guids, const GUID& ns, const char *const *names,
+                                const size_t *lengths, size_t count, bool sha1)
+{
+    uint8_t bytes[16];
+    guid_to_bytes(bytes, ns);
+
+    size_t i = 0;
+#ifdef GUID_USE_SSE2
+    for (; i + 4 <= count; i += 4)
+        guid_generate_name4(&guids[i], bytes, &names[i], &lengths[i], sha1);
+#endif
+    for (; i < count; ++i)
+        guid_generate_name1(guids[i], bytes, names[i], lengths[i], sha1);
+}
+
+void guid_generate_v5(GUID& guid, const GUID& ns, const char *name, size_t cch)
+{
+    guid_generate_names(&guid, ns, &name, &cch, 1, true);
+}
+
+void guid_generate_v3(GUID& guid, const GUID& ns, const char *name, size_t cch)
+{
+    guid_generate_names(&guid, ns, &name, &cch, 1, false);
+}
+
+void guid_generate_v5(GUID *guids, const GUID& ns, const char *const *names, const size_t *lengths,
+                      size_t count)
+{
+    guid_generate_names(guids, ns, names, lengths, count, true);
+}
+
+void guid_generate_v3(GUID *guids, const GUID& ns, const char *const *names, const size_t *lengths,
+                      size_t count)
+{
+    guid_generate_names(guids, ns, names, lengths, count, false);
+}
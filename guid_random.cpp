@@ -0,0 +1,535 @@
+// guid_random.cpp - Random GUIDs from a ChaCha20 keystream
+// License: MIT
+
+#define _CRT_RAND_S // for rand_s
+#include "guid.h"
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#if defined(_WIN32)
+    #define GUID_ENTROPY_RAND_S
+#elif defined(__linux__)
+    #define GUID_ENTROPY_GETRANDOM
+    #include <sys/random.h>
+    #include <errno.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    #define GUID_ENTROPY_ARC4RANDOM
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define GUID_RANDOM_FORK_CHECK
+    #include <pthread.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GUID_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// The entropy of the OS
+
+#ifndef GUID_ENTROPY_ARC4RANDOM
+static bool guid_read_urandom(void *buf, size_t size)
+{
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (!fp)
+        return false;
+    bool ok = fread(buf, 1, size, fp) == size;
+    fclose(fp);
+    return ok;
+}
+#endif
+
+bool guid_random_bytes(void *buf, size_t size)
+{
+    uint8_t *pb = reinterpret_cast<uint8_t *>(buf);
+#if defined(GUID_ENTROPY_RAND_S)
+    while (size > 0)
+    {
+        unsigned int value;
+        if (rand_s(&value) != 0)
+            return false;
+        size_t cb = (size < sizeof(value)) ? size : sizeof(value);
+        memcpy(pb, &value, cb);
+        pb += cb;
+        size -= cb;
+    }
+    return true;
+#elif defined(GUID_ENTROPY_GETRANDOM)
+    while (size > 0)
+    {
+        ssize_t cb = getrandom(pb, size, 0);
+        if (cb < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return guid_read_urandom(pb, size); // ENOSYS on old kernels
+        }
+        pb += cb;
+        size -= (size_t)cb;
+    }
+    return true;
+#elif defined(GUID_ENTROPY_ARC4RANDOM)
+    arc4random_buf(pb, size);
+    return true;
+#else
+    return guid_read_urandom(pb, size);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// ChaCha20 (64-bit block counter in state[12..13], 64-bit nonce in state[14..15])
+
+#define GUID_CHACHA_BLOCK_SIZE 64
+
+static inline uint32_t guid_rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t guid_load_le32(const uint8_t *pb)
+{
+    return pb[0] | (pb[1] << 8) | (pb[2] << 16) | ((uint32_t)pb[3] << 24);
+}
+
+static inline void guid_store_le32(uint8_t *pb, uint32_t value)
+{
+    pb[0] = (uint8_t)value;
+    pb[1] = (uint8_t)(value >> 8);
+    pb[2] = (uint8_t)(value >> 16);
+    pb[3] = (uint8_t)(value >> 24);
+}
+
+static inline void guid_chacha_next(uint32_t *state)
+{
+    if (++state[12] == 0)
+        ++state[13];
+}
+
+#define GUID_QUARTER_ROUND(a, b, c, d) \
+    a += b; d = guid_rotl(d ^ a, 16); \
+    c += d; b = guid_rotl(b ^ c, 12); \
+    a += b; d = guid_rotl(d ^ a, 8); \
+    c += d; b = guid_rotl(b ^ c, 7)
+
+#ifdef GUID_USE_SSE2
+#define GUID_ROTL_SSE2(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+static inline __m128i guid_rotl16_sse2(__m128i v)
+{
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+}
+
+#define GUID_QUARTER_ROUND_SSE2(a, b, c, d) \
+    a = _mm_add_epi32(a, b); d = guid_rotl16_sse2(_mm_xor_si128(d, a)); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = GUID_ROTL_SSE2(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = GUID_ROTL_SSE2(d, 8); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = GUID_ROTL_SSE2(b, 7)
+
+// Four blocks into out[0..256) at once, a lane per block
+static void guid_chacha_block4(uint32_t *state, uint8_t *out)
+{
+    __m128i input[16], x[16];
+    for (int i = 0; i < 16; ++i)
+        input[i] = _mm_set1_epi32((int)state[i]);
+
+    uint32_t low[4], high[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        low[i] = state[12];
+        high[i] = state[13];
+        guid_chacha_next(state);
+    }
+    input[12] = _mm_setr_epi32((int)low[0], (int)low[1], (int)low[2], (int)low[3]);
+    input[13] = _mm_setr_epi32((int)high[0], (int)high[1], (int)high[2], (int)high[3]);
+
+    for (int i = 0; i < 16; ++i)
+        x[i] = input[i];
+
+    for (int i = 0; i < 10; ++i)
+    {
+        GUID_QUARTER_ROUND_SSE2(x[0], x[4], x[8], x[12]);
+        GUID_QUARTER_ROUND_SSE2(x[1], x[5], x[9], x[13]);
+        GUID_QUARTER_ROUND_SSE2(x[2], x[6], x[10], x[14]);
+        GUID_QUARTER_ROUND_SSE2(x[3], x[7], x[11], x[15]);
+        GUID_QUARTER_ROUND_SSE2(x[0], x[5], x[10], x[15]);
+        GUID_QUARTER_ROUND_SSE2(x[1], x[6], x[11], x[12]);
+        GUID_QUARTER_ROUND_SSE2(x[2], x[7], x[8], x[13]);
+        GUID_QUARTER_ROUND_SSE2(x[3], x[4], x[9], x[14]);
+    }
+
+    // Transpose each group of four words to the four blocks
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128i a = _mm_add_epi32(x[i + 0], input[i + 0]);
+        __m128i b = _mm_add_epi32(x[i + 1], input[i + 1]);
+        __m128i c = _mm_add_epi32(x[i + 2], input[i + 2]);
+        __m128i d = _mm_add_epi32(x[i + 3], input[i + 3]);
+        __m128i ab_lo = _mm_unpacklo_epi32(a, b), ab_hi = _mm_unpackhi_epi32(a, b);
+        __m128i cd_lo = _mm_unpacklo_epi32(c, d), cd_hi = _mm_unpackhi_epi32(c, d);
+        uint8_t *pb = &out[i * 4];
+        _mm_storeu_si128((__m128i *)(pb + 0 * GUID_CHACHA_BLOCK_SIZE), _mm_unpacklo_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128((__m128i *)(pb + 1 * GUID_CHACHA_BLOCK_SIZE), _mm_unpackhi_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128((__m128i *)(pb + 2 * GUID_CHACHA_BLOCK_SIZE), _mm_unpacklo_epi64(ab_hi, cd_hi));
+        _mm_storeu_si128((__m128i *)(pb + 3 * GUID_CHACHA_BLOCK_SIZE), _mm_unpackhi_epi64(ab_hi, cd_hi));
+    }
+}
+#else
+// One block into out[0..64)
+static void guid_chacha_block(uint32_t *state, uint8_t *out)
+{
+    uint32_t x[16];
+    memcpy(x, state, sizeof(x));
+
+    for (int i = 0; i < 10; ++i)
+    {
+        GUID_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        GUID_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        GUID_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        GUID_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        GUID_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        GUID_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        GUID_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        GUID_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; ++i)
+        guid_store_le32(&out[i * 4], x[i] + state[i]);
+
+    guid_chacha_next(state);
+}
+
+static void guid_chacha_block4(uint32_t *state, uint8_t *out)
+{
+    for (int i = 0; i < 4; ++i)
+        guid_chacha_block(state, &out[i * GUID_CHACHA_BLOCK_SIZE]);
+}
+#endif
+
+static_assert(GUID_RANDOM_BUFFER_SIZE == 4 * GUID_CHACHA_BLOCK_SIZE, "Four blocks per refill");
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// GUID_RANDOM
+
+void guid_random_init(GUID_RANDOM& rng, const uint8_t *key, uint64_t stream)
+{
+    rng.state[0] = 0x61707865; // "expand 32-byte k"
+    rng.state[1] = 0x3320646E;
+    rng.state[2] = 0x79622D32;
+    rng.state[3] = 0x6B206574;
+    for (int i = 0; i < 8; ++i)
+        rng.state[4 + i] = guid_load_le32(&key[i * 4]);
+    rng.state[12] = rng.state[13] = 0;
+    rng.state[14] = (uint32_t)stream;
+    rng.state[15] = (uint32_t)(stream >> 32);
+    rng.used = GUID_RANDOM_BUFFER_SIZE;
+}
+
+bool guid_random_init(GUID_RANDOM& rng)
+{
+    uint8_t seed[32 + 8];
+    if (!guid_random_bytes(seed, sizeof(seed)))
+        return false;
+
+    uint64_t stream;
+    memcpy(&stream, &seed[32], sizeof(stream));
+    guid_random_init(rng, seed, stream);
+    memset(seed, 0, sizeof(seed));
+    return true;
+}
+
+void guid_random_fill(GUID_RANDOM& rng, void *buf, size_t size)
+{
+    uint8_t *pb = reinterpret_cast<uint8_t *>(buf);
+
+    size_t cb = GUID_RANDOM_BUFFER_SIZE - rng.used;
+    if (cb > size)
+        cb = size;
+    memcpy(pb, &rng.buffer[rng.used], cb);
+    rng.used += cb;
+    pb += cb;
+    size -= cb;
+
+    // Whole refills go straight into buf
+    for (; size >= GUID_RANDOM_BUFFER_SIZE; pb += GUID_RANDOM_BUFFER_SIZE, size -= GUID_RANDOM_BUFFER_SIZE)
+        guid_chacha_block4(rng.state, pb);
+
+    if (size > 0)
+    {
+        guid_chacha_block4(rng.state, rng.buffer);
+        memcpy(pb, rng.buffer, size);
+        rng.used = size;
+    }
+}
+
+void guid_random_generate(GUID_RANDOM& rng, GUID *guids, size_t count)
+{
+    static_assert(sizeof(GUID) == 16, "GUID must be 16 bytes");
+    guid_random_fill(rng, guids, count * sizeof(GUID));
+
+    // Version 4 in the top of Data3 and the variant 10xx in the top of Data4[0]
+#ifdef GUID_USE_SSE2
+    const __m128i and_mask = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, 0x0F, 0x3F, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i or_mask = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(&guids[i]);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(p), and_mask), or_mask));
+    }
+#else
+    for (size_t i = 0; i < count; ++i)
+    {
+        guids[i].Data3 = (guids[i].Data3 & 0x0FFF) | 0x4000;
+        guids[i].Data4[0] = (guids[i].Data4[0] & 0x3F) | 0x80;
+    }
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// GUID_V7
+
+#define GUID_V7_COUNTER_MAX ((uint64_t(1) << 42) - 1)
+
+static uint64_t guid_unix_ms(void)
+{
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+bool guid_v7_init(GUID_V7& gen)
+{
+    gen.last_ms = gen.counter = 0;
+    return guid_random_init(gen.rng);
+}
+
+void guid_generate_v7(GUID_V7& gen, GUID *guids, size_t count)
+{
+    guid_random_fill(gen.rng, guids, count * sizeof(GUID));
+
+    // The clock is read once per call. The counter keeps the order within a millisecond,
+    // and across a clock that goes back
+    uint64_t ms = guid_unix_ms();
+    for (size_t i = 0; i < count; ++i)
+    {
+        GUID& guid = guids[i];
+
+        // A new millisecond starts the counter at random with the top bit clear, to leave
+        // room for 2^41 increments. Data1 and Data2 are random here
+        uint64_t seed = ((uint64_t)(guid.Data2 & 0x1FF) << 32) | guid.Data1;
+        if (ms > gen.last_ms)
+        {
+            gen.last_ms = ms;
+            gen.counter = seed;
+        }
+        else if (++gen.counter > GUID_V7_COUNTER_MAX)
+        {
+            ++gen.last_ms; // borrows the next millisecond
+            gen.counter = seed;
+        }
+
+        // 48-bit milliseconds, version 7, then the 42-bit counter across rand_a and the
+        // variant byte, then 32 random bits in Data4[4..7]
+        guid.Data1 = (uint32_t)(gen.last_ms >> 16);
+        guid.Data2 = (uint16_t)gen.last_ms;
+        guid.Data3 = (uint16_t)(0x7000 | (gen.counter >> 30));
+        guid.Data4[0] = (uint8_t)(0x80 | ((gen.counter >> 24) & 0x3F));
+        guid.Data4[1] = (uint8_t)(gen.counter >> 16);
+        guid.Data4[2] = (uint8_t)(gen.counter >> 8);
+        guid.Data4[3] = (uint8_t)gen.counter;
+    }
+}
+
+#ifdef GUID_RANDOM_FORK_CHECK
+// The number of forks, so that a child does not repeat the keystreams of the parent.
+// Cheaper than a getpid() per call
+static std::atomic<unsigned> s_forks(0);
+
+static void guid_on_fork(void)
+{
+    ++s_forks;
+}
+#endif
+
+// The generator of the calling thread for the single-GUID functions. No locks are needed
+static GUID_V7 *guid_thread_generator(void)
+{
+    static thread_local GUID_V7 s_gen;
+    static thread_local bool s_seeded = false;
+#ifdef GUID_RANDOM_FORK_CHECK
+    static const bool s_atfork = (pthread_atfork(NULL, NULL, guid_on_fork) == 0);
+    static thread_local unsigned s_fork = 0;
+    unsigned forks = s_forks.load(std::memory_order_relaxed);
+    if (s_fork != forks || !s_atfork)
+    {
+        s_fork = forks;
+        s_seeded = false;
+    }
+#endif
+    if (!s_seeded && !(s_seeded = guid_v7_init(s_gen)))
+        return NULL;
+    return &s_gen;
+}
+
+bool guid_random_generate(GUID& guid)
+{
+    GUID_V7 *gen = guid_thread_generator();
+    if (!gen)
+        return false;
+    guid_random_generate(gen->rng, &guid, 1);
+    return true;
+}
+
+bool guid_generate_v7(GUID& guid)
+{
+    GUID_V7 *gen = guid_thread_generator();
+    if (!gen)
+        return false;
+    guid_generate_v7(*gen, &guid, 1);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// GuidReservoir
+//
+// A bounded queue of one producer (the refill thread) and many consumers. Each slot has a
+// sequence number: pos + 1 when it holds the GUID of position pos, pos + capacity when it is
+// free for the position pos + capacity.
+
+struct GUID_RESERVOIR_SLOT
+{
+    std::atomic<size_t> seq;
+    GUID guid;
+};
+
+struct GUID_RESERVOIR
+{
+    std::vector<GUID_RESERVOIR_SLOT> slots;
+    size_t mask;
+    size_t low_water;
+    alignas(64) std::atomic<size_t> head;   // the next position to take
+    alignas(64) std::atomic<size_t> tail;   // the next position to fill
+    std::atomic<bool> wake;
+    bool stop;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+
+    explicit GUID_RESERVOIR(size_t capacity) : slots(capacity), mask(capacity - 1),
+        low_water(capacity / 4), head(0), tail(0), wake(false), stop(false)
+    {
+        for (size_t i = 0; i < capacity; ++i)
+            slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    void refill();
+};
+
+void GUID_RESERVOIR::refill()
+{
+    GUID_RANDOM rng;
+    bool seeded = guid_random_init(rng);
+
+    GUID guids[64];
+    size_t count = 0, used = 0;
+    for (;;)
+    {
+        // Fill up the free slots
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (seeded)
+        {
+            GUID_RESERVOIR_SLOT& slot = slots[pos & mask];
+            if (slot.seq.load(std::memory_order_acquire) != pos)
+                break; // full
+            if (used == count)
+            {
+                count = _countof(guids);
+                used = 0;
+                guid_random_generate(rng, guids, count);
+            }
+            slot.guid = guids[used++];
+            slot.seq.store(pos + 1, std::memory_order_release);
+            tail.store(++pos, std::memory_order_relaxed);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return stop || wake.load(); });
+        if (stop)
+            break;
+        wake = false;
+    }
+}
+
+GuidReservoir::GuidReservoir(size_t capacity)
+{
+    size_t size = 16;
+    while (size < capacity)
+        size *= 2;
+    m_impl = new GUID_RESERVOIR(size);
+    m_impl->thread = std::thread(&GUID_RESERVOIR::refill, m_impl);
+}
+
+GuidReservoir::~GuidReservoir()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->stop = true;
+    }
+    m_impl->cond.notify_one();
+    m_impl->thread.join();
+    delete m_impl;
+}
+
+bool GuidReservoir::take(GUID& guid)
+{
+    GUID_RESERVOIR& impl = *m_impl;
+    size_t pos = impl.head.load(std::memory_order_relaxed);
+    bool taken = false;
+    for (;;)
+    {
+        GUID_RESERVOIR_SLOT& slot = impl.slots[pos & impl.mask];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == pos + 1)
+        {
+            if (impl.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                guid = slot.guid;
+                slot.seq.store(pos + impl.mask + 1, std::memory_order_release);
+                taken = true;
+                break;
+            }
+            // pos is reloaded by the failure
+        }
+        else if ((ptrdiff_t)(seq - (pos + 1)) < 0)
+        {
+            break; // empty
+        }
+        else
+        {
+            pos = impl.head.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Wake the refill thread once per refill when running low. The lock makes sure that the
+    // thread is waiting or sees the flag
+    size_t left = impl.tail.load(std::memory_order_relaxed) - impl.head.load(std::memory_order_relaxed);
+    if ((ptrdiff_t)left <= (ptrdiff_t)impl.low_water && !impl.wake.exchange(true))
+    {
+        std::lock_guard<std::mutex> lock(impl.mutex);
+        impl.cond.notify_one();
+    }
+
+    return taken || guid_random_generate(guid);
+}
+
+size_t GuidReservoir::size() const
+{
+    ptrdiff_t left = m_impl->tail.load(std::memory_order_relaxed) - m_impl->head.load(std::memory_order_relaxed);
+    return (left > 0) ? (size_t)left : 0;
+}
@@ -0,0 +1,472 @@
+// guid_text.cpp - Fixed-width GUID text kernels
+// License: MIT
+
+#include "guid.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GUID_USE_SSE2
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+    #if defined(__SSSE3__) || defined(__AVX__)
+        #define GUID_USE_SSSE3
+        #include <tmmintrin.h>
+    #endif
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoding "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}"
+
+#ifdef GUID_USE_SSE2
+
+// v0, v1 and v2 are the characters at 0-15, 16-31 and 22-37, narrowed into bytes.
+// The last one overlaps so that no character after the text is read
+static inline bool guid_decode_text_vectors(GUID& guid, __m128i v0, __m128i v1, __m128i v2)
+{
+    // The punctuations: '{' at 0, '-' at 9, 14, 19, 24 and '}' at 37
+    const __m128i p0 = _mm_setr_epi8('{', 0, 0, 0, 0, 0, 0, 0, 0, '-', 0, 0, 0, 0, '-', 0);
+    const __m128i p1 = _mm_setr_epi8(0, 0, 0, '-', 0, 0, 0, 0, '-', 0, 0, 0, 0, 0, 0, 0);
+    const __m128i p2 = _mm_setr_epi8(0, 0, '-', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '}');
+    const uint64_t punct_mask = (1ULL << 0) | (1ULL << 9) | (1ULL << 14) | (1ULL << 19) |
+                                (1ULL << 24) | (1ULL << 37);
+    const uint64_t hex_mask = ((1ULL << GUID_TEXT_LENGTH) - 1) & ~punct_mask;
+
+    uint64_t punct = (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v0, p0)) |
+                     ((uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v1, p1)) << 16) |
+                     ((uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v2, p2)) << 22);
+
+    // Classify the hex digits. Bytes of 0x80 or more are negative and never match
+    const __m128i ch_0 = _mm_set1_epi8('0' - 1), ch_9 = _mm_set1_epi8('9' + 1);
+    const __m128i ch_a = _mm_set1_epi8('a' - 1), ch_f = _mm_set1_epi8('f' + 1);
+    const __m128i lower = _mm_set1_epi8(0x20), nine = _mm_set1_epi8(9), low4 = _mm_set1_epi8(0x0F);
+#define GUID_NIBBLES(v, alpha, hex) \
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(_mm_or_si128(v, lower), ch_a), \
+                                  _mm_cmplt_epi8(_mm_or_si128(v, lower), ch_f)); \
+    uint64_t hex = (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(alpha, \
+        _mm_and_si128(_mm_cmpgt_epi8(v, ch_0), _mm_cmplt_epi8(v, ch_9))))
+    GUID_NIBBLES(v0, alpha0, hex0);
+    GUID_NIBBLES(v1, alpha1, hex1);
+    GUID_NIBBLES(v2, alpha2, hex2);
+#undef GUID_NIBBLES
+    uint64_t hex = hex0 | (hex1 << 16) | (hex2 << 22);
+    if ((punct & punct_mask) != punct_mask || (hex & hex_mask) != hex_mask)
+        return false;
+
+    // '0'-'9' --> 0-9, 'A'-'F' and 'a'-'f' --> 1-6 + 9
+    v0 = _mm_add_epi8(_mm_and_si128(v0, low4), _mm_and_si128(alpha0, nine));
+    v1 = _mm_add_epi8(_mm_and_si128(v1, low4), _mm_and_si128(alpha1, nine));
+    v2 = _mm_add_epi8(_mm_and_si128(v2, low4), _mm_and_si128(alpha2, nine));
+
+#ifdef GUID_USE_SSSE3
+    // Gather the upper and lower nibbles into the byte order of GUID in memory (x86 is
+    // little-endian). Indexes with the top bit set give zeros
+    const __m128i hi0 = _mm_setr_epi8(7, 5, 3, 1, 12, 10, -1, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i hi1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 1, -1, 4, 6, 9, 11, 13, 15, -1, -1);
+    const __m128i hi2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 11, 13);
+    const __m128i lo0 = _mm_setr_epi8(8, 6, 4, 2, 13, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i lo1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 0, 5, 7, 10, 12, 14, -1, -1, -1);
+    const __m128i lo2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 10, 12, 14);
+    __m128i hi = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, hi0), _mm_shuffle_epi8(v1, hi1)),
+                              _mm_shuffle_epi8(v2, hi2));
+    __m128i lo = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, lo0), _mm_shuffle_epi8(v1, lo1)),
+                              _mm_shuffle_epi8(v2, lo2));
+    _mm_storeu_si128((__m128i *)&guid, _mm_or_si128(_mm_slli_epi16(hi, 4), lo));
+#else
+    // Make the byte of each nibble and its next one, and pick up the 16 bytes
+    __m128i next0 = _mm_or_si128(_mm_srli_si128(v0, 1), _mm_slli_si128(v1, 15));
+    uint8_t pairs[48];
+    _mm_storeu_si128((__m128i *)&pairs[0], _mm_or_si128(_mm_slli_epi16(v0, 4), next0));
+    _mm_storeu_si128((__m128i *)&pairs[16], _mm_or_si128(_mm_slli_epi16(v1, 4), _mm_srli_si128(v1, 1)));
+    _mm_storeu_si128((__m128i *)&pairs[32], _mm_or_si128(_mm_slli_epi16(v2, 4), _mm_srli_si128(v2, 1)));
+
+    // In the byte order of GUID in memory (x86 is little-endian). pairs[32 + i] is at 22 + i
+    static const uint8_t s_pair_index[16] =
+    {
+        7, 5, 3, 1, 12, 10, 16 + 1, 15, 16 + 4, 32 + 0, 32 + 3, 32 + 5, 32 + 7, 32 + 9, 32 + 11, 32 + 13
+    };
+    uint8_t *pb = (uint8_t *)&guid;
+    for (int i = 0; i < 16; ++i)
+        pb[i] = pairs[s_pair_index[i]];
+#endif
+
+    return true;
+}
+
+bool guid_decode_guid_text(GUID& guid, const char *text)
+{
+    return guid_decode_text_vectors(guid,
+        _mm_loadu_si128((const __m128i *)&text[0]),
+        _mm_loadu_si128((const __m128i *)&text[16]),
+        _mm_loadu_si128((const __m128i *)&text[22]));
+}
+
+// Narrows 16 characters with saturation. Non-ASCII characters become 0x00 or 0xFF,
+// which are invalid anyway
+static inline __m128i guid_narrow16(const wchar_t *text)
+{
+    const __m128i *pv = (const __m128i *)text;
+    if (sizeof(wchar_t) == 2)
+        return _mm_packus_epi16(_mm_loadu_si128(&pv[0]), _mm_loadu_si128(&pv[1]));
+
+    return _mm_packus_epi16(_mm_packs_epi32(_mm_loadu_si128(&pv[0]), _mm_loadu_si128(&pv[1])),
+                            _mm_packs_epi32(_mm_loadu_si128(&pv[2]), _mm_loadu_si128(&pv[3])));
+}
+
+bool guid_decode_guid_text(GUID& guid, const wchar_t *text)
+{
+    return guid_decode_text_vectors(guid, guid_narrow16(&text[0]), guid_narrow16(&text[16]),
+                                    guid_narrow16(&text[22]));
+}
+
+#else // ndef GUID_USE_SSE2
+
+// The positions of the upper nibbles of the 16 bytes in the text order. The lower ones follow
+static const uint8_t s_hex_pos[16] =
+{
+    1, 3, 5, 7, 10, 12, 15, 17, 20, 22, 25, 27, 29, 31, 33, 35
+};
+
+static inline void guid_from_text_bytes(GUID& guid, const uint8_t *pb)
+{
+    guid.Data1 = ((uint32_t)pb[0] << 24) | ((uint32_t)pb[1] << 16) | ((uint32_t)pb[2] << 8) | pb[3];
+    guid.Data2 = (uint16_t)((pb[4] << 8) | pb[5]);
+    guid.Data3 = (uint16_t)((pb[6] << 8) | pb[7]);
+    memcpy(guid.Data4, &pb[8], 8);
+}
+
+// 0xFF for non-hex
+static const uint8_t s_hex_values[256] =
+{
+#define X 0xFF
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x00 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x10 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x20 */
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, X, X, X, X, X, X, /* 0x30 */
+    X, 10, 11, 12, 13, 14, 15, X, X, X, X, X, X, X, X, X, /* 0x40 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x50 */
+    X, 10, 11, 12, 13, 14, 15, X, X, X, X, X, X, X, X, X, /* 0x60 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x70 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x80 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0x90 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0xA0 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0xB0 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0xC0 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0xD0 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0xE0 */
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, /* 0xF0 */
+#undef X
+};
+
+template <typename T_CHAR>
+static inline bool guid_decode_guid_text_t(GUID& guid, const T_CHAR *text)
+{
+    if (text[0] != '{' || text[9] != '-' || text[14] != '-' || text[19] != '-' ||
+        text[24] != '-' || text[37] != '}')
+    {
+        return false;
+    }
+
+    uint8_t bytes[16];
+    unsigned bad = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        auto ch0 = text[s_hex_pos[i]], ch1 = text[s_hex_pos[i] + 1];
+        uint8_t hi = (ch0 & ~0xFF) ? 0xFF : s_hex_values[(uint8_t)ch0];
+        uint8_t lo = (ch1 & ~0xFF) ? 0xFF : s_hex_values[(uint8_t)ch1];
+        bad |= hi | lo;
+        bytes[i] = (uint8_t)((hi << 4) | lo);
+    }
+    if (bad & 0xF0)
+        return false;
+
+    guid_from_text_bytes(guid, bytes);
+    return true;
+}
+
+bool guid_decode_guid_text(GUID& guid, const char *text)
+{
+    return guid_decode_guid_text_t(guid, text);
+}
+
+bool guid_decode_guid_text(GUID& guid, const wchar_t *text)
+{
+    return guid_decode_guid_text_t(guid, text);
+}
+
+#endif // ndef GUID_USE_SSE2
+
+bool guid_decode_bare_text(GUID& guid, const char *text)
+{
+    char buf[GUID_TEXT_LENGTH];
+    buf[0] = '{';
+    memcpy(&buf[1], text, GUID_BARE_TEXT_LENGTH);
+    buf[GUID_TEXT_LENGTH - 1] = '}';
+    return guid_decode_guid_text(guid, buf);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Finding "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"
+//
+// The dashes are rare in text, so the places of '-' at 8, 13, 18 and 23 with no '-' next to
+// them leave few candidates to decode.
+
+// The bits of the candidates from the bits of the dashes. Bit i needs bits up to i + 24
+static inline uint64_t guid_bare_candidates(uint64_t dash)
+{
+    uint64_t bits = (dash >> 8) & (dash >> 13) & (dash >> 18) & (dash >> 23);
+    return bits & ~((dash >> 7) | (dash >> 9) | (dash >> 12) | (dash >> 14) |
+                    (dash >> 17) | (dash >> 19) | (dash >> 22) | (dash >> 24));
+}
+
+static inline bool guid_is_bare_candidate(const char *pch)
+{
+    return pch[8] == '-' && pch[13] == '-' && pch[18] == '-' && pch[23] == '-' &&
+           pch[7] != '-' && pch[9] != '-' && pch[12] != '-' && pch[14] != '-' &&
+           pch[17] != '-' && pch[19] != '-' && pch[22] != '-' && pch[24] != '-';
+}
+
+#ifdef GUID_USE_SSE2
+static inline int guid_lowest_bit(uint32_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+// The bits of '-' in 32 bytes
+static inline uint32_t guid_dash_bits(const char *pch)
+{
+    const __m128i dash = _mm_set1_epi8('-');
+    __m128i v0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)pch), dash);
+    __m128i v1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(pch + 16)), dash);
+    return (uint32_t)(uint16_t)_mm_movemask_epi8(v0) | ((uint32_t)_mm_movemask_epi8(v1) << 16);
+}
+#endif
+
+const char *guid_find_bare_text(const char *text, const char *end)
+{
+    const char *pch = text;
+#ifdef GUID_USE_SSE2
+    // 32 starts at a time, with the dashes of the next 32 bytes. A start found has
+    // GUID_BARE_TEXT_LENGTH characters before end
+    if (end - pch >= 32 + 32 + 4)
+    {
+        uint32_t dash = guid_dash_bits(pch);
+        for (; end - pch >= 32 + 32 + 4; pch += 32)
+        {
+            uint32_t next = guid_dash_bits(pch + 32);
+            uint32_t bits = (uint32_t)guid_bare_candidates(dash | ((uint64_t)next << 32));
+            if (bits)
+                return pch + guid_lowest_bit(bits);
+            dash = next;
+        }
+    }
+#endif
+
+    for (; end - pch >= GUID_BARE_TEXT_LENGTH; ++pch)
+    {
+        if (guid_is_bare_candidate(pch))
+            return pch;
+    }
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Formatting
+
+// In the templates below, each 'X' is replaced with a hex digit
+static const char s_guid_template[] = "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}";
+static const char s_hex_template[] = "XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX";
+static const char s_struct_template[] =
+    "{ 0xXXXXXXXX, 0xXXXX, 0xXXXX, { 0xXX, 0xXX, 0xXX, 0xXX, 0xXX, 0xXX, 0xXX, 0xXX } }";
+static const char s_definition_template[] =
+    ", 0xXXXXXXXX, 0xXXXX, 0xXXXX, 0xXX, 0xXX, 0xXX, 0xXX, 0xXX, 0xXX, 0xXX, 0xXX);";
+static const char s_definition_prefix[] = "DEFINE_GUID(";
+static const char s_default_name[] = "<Name>";
+
+static_assert(sizeof(s_guid_template) - 1 == GUID_TEXT_LENGTH, "");
+static_assert(sizeof(s_hex_template) - 1 == GUID_HEX_TEXT_LENGTH, "");
+static_assert(sizeof(s_struct_template) - 1 == GUID_STRUCT_TEXT_LENGTH, "");
+
+// The 32 upper-case hex digits of 16 bytes
+static inline void guid_hex_digits(char *digits, const uint8_t *pb)
+{
+#ifdef GUID_USE_SSE2
+    const __m128i low4 = _mm_set1_epi8(0x0F), nine = _mm_set1_epi8(9);
+    const __m128i ch_0 = _mm_set1_epi8('0'), alpha = _mm_set1_epi8('A' - '0' - 10);
+    __m128i v = _mm_loadu_si128((const __m128i *)pb);
+    __m128i lo = _mm_and_si128(v, low4);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low4);
+    __m128i n0 = _mm_unpacklo_epi8(hi, lo), n1 = _mm_unpackhi_epi8(hi, lo);
+    // n + '0' + (n > 9 ? 'A' - '0' - 10 : 0)
+    n0 = _mm_add_epi8(_mm_add_epi8(n0, ch_0), _mm_and_si128(_mm_cmpgt_epi8(n0, nine), alpha));
+    n1 = _mm_add_epi8(_mm_add_epi8(n1, ch_0), _mm_and_si128(_mm_cmpgt_epi8(n1, nine), alpha));
+    _mm_storeu_si128((__m128i *)&digits[0], n0);
+    _mm_storeu_si128((__m128i *)&digits[16], n1);
+#else
+    static const char s_nibbles[] = "0123456789ABCDEF";
+    for (int i = 0; i < 16; ++i)
+    {
+        digits[2 * i + 0] = s_nibbles[pb[i] >> 4];
+        digits[2 * i + 1] = s_nibbles[pb[i] & 0xF];
+    }
+#endif
+}
+
+// The digits in the order of the text (Data1, Data2 and Data3 are big-endian)
+static inline void guid_text_digits(char *digits, const GUID& guid)
+{
+    uint8_t bytes[16] =
+    {
+        (uint8_t)(guid.Data1 >> 24), (uint8_t)(guid.Data1 >> 16), (uint8_t)(guid.Data1 >> 8),
+        (uint8_t)guid.Data1, (uint8_t)(guid.Data2 >> 8), (uint8_t)guid.Data2,
+        (uint8_t)(guid.Data3 >> 8), (uint8_t)guid.Data3
+    };
+    memcpy(&bytes[8], guid.Data4, 8);
+    guid_hex_digits(digits, bytes);
+}
+
+template <typename T_CHAR>
+static inline T_CHAR *guid_fill(T_CHAR *out, const char *tmpl, const char *digits)
+{
+    for (; *tmpl; ++tmpl)
+        *out++ = (*tmpl == 'X') ? *digits++ : *tmpl;
+    return out;
+}
+
+template <typename T_CHAR>
+static inline T_CHAR *guid_copy(T_CHAR *out, const char *str)
+{
+    while (*str)
+        *out++ = *str++;
+    return out;
+}
+
+template <typename T_CHAR>
+static inline T_CHAR *guid_copy(T_CHAR *out, const T_CHAR *str, size_t cch)
+{
+    memcpy(out, str, cch * sizeof(T_CHAR));
+    return out + cch;
+}
+
+template <typename T_CHAR>
+static inline size_t guid_length(const T_CHAR *str)
+{
+    size_t cch = 0;
+    while (str[cch])
+        ++cch;
+    return cch;
+}
+
+// Copies a run of digits. For char, a memcpy of fixed size
+template <typename T_CHAR>
+static inline T_CHAR *guid_put(T_CHAR *out, const char *digits, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        out[i] = digits[i];
+    return out + count;
+}
+
+template <typename T_CHAR>
+static size_t guid_format_guid_text_t(T_CHAR *buf, const GUID& guid)
+{
+    // The hottest format (--generate), so the runs of the template are unrolled
+    char digits[32];
+    guid_text_digits(digits, guid);
+    T_CHAR *out = buf;
+    *out++ = '{';
+    out = guid_put(out, &digits[0], 8);
+    *out++ = '-';
+    out = guid_put(out, &digits[8], 4);
+    *out++ = '-';
+    out = guid_put(out, &digits[12], 4);
+    *out++ = '-';
+    out = guid_put(out, &digits[16], 4);
+    *out++ = '-';
+    out = guid_put(out, &digits[20], 12);
+    *out++ = '}';
+    *out = 0;
+    return GUID_TEXT_LENGTH;
+}
+
+template <typename T_CHAR>
+static size_t guid_format_hex_text_t(T_CHAR *buf, const GUID& guid)
+{
+    // In the byte order of memory
+    char digits[32];
+    guid_hex_digits(digits, (const uint8_t *)&guid);
+    *guid_fill(buf, s_hex_template, digits) = 0;
+    return GUID_HEX_TEXT_LENGTH;
+}
+
+template <typename T_CHAR>
+static size_t guid_format_struct_text_t(T_CHAR *buf, const GUID& guid)
+{
+    char digits[32];
+    guid_text_digits(digits, guid);
+    *guid_fill(buf, s_struct_template, digits) = 0;
+    return GUID_STRUCT_TEXT_LENGTH;
+}
+
+template <typename T_CHAR>
+static size_t guid_format_definition_t(T_CHAR *buf, size_t cch, const GUID& guid, const T_CHAR *name)
+{
+    size_t name_len = (name && name[0]) ? guid_length(name) : 0;
+    size_t len = (sizeof(s_definition_prefix) - 1) + (name_len ? name_len : sizeof(s_default_name) - 1) +
+                 (sizeof(s_definition_template) - 1);
+    if (cch <= len)
+        return len;
+
+    char digits[32];
+    guid_text_digits(digits, guid);
+    T_CHAR *out = guid_copy(buf, s_definition_prefix);
+    out = name_len ? guid_copy(out, name, name_len) : guid_copy(out, s_default_name);
+    *guid_fill(out, s_definition_template, digits) = 0;
+    return len;
+}
+
+size_t guid_format_guid_text(char *buf, const GUID& guid)
+{
+    return guid_format_guid_text_t(buf, guid);
+}
+
+size_t guid_format_guid_text(wchar_t *buf, const GUID& guid)
+{
+    return guid_format_guid_text_t(buf, guid);
+}
+
+size_t guid_format_hex_text(char *buf, const GUID& guid)
+{
+    return guid_format_hex_text_t(buf, guid);
+}
+
+size_t guid_format_hex_text(wchar_t *buf, const GUID& guid)
+{
+    return guid_format_hex_text_t(buf, guid);
+}
+
+size_t guid_format_struct_text(char *buf, const GUID& guid)
+{
+    return guid_format_struct_text_t(buf, guid);
+}
+
+size_t guid_format_struct_text(wchar_t *buf, const GUID& guid)
+{
+    return guid_format_struct_text_t(buf, guid);
+}
+
+size_t guid_format_definition(char *buf, size_t cch, const GUID& guid, const char *name)
+{
+    return guid_format_definition_t(buf, cch, guid, name);
+}
+
+size_t guid_format_definition(wchar_t *buf, size_t cch, const GUID& guid, const wchar_t *name)
+{
+    return guid_format_definition_t(buf, cch, guid, name);
+}
@@ -4,141 +4,1839 @@
 #define INITGUID
 #include "guid.h"
 #include <cassert>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <algorithm>
+#include <unordered_map>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define RGUID_WRITEV
+    #include <sys/uio.h>
+    #include <unistd.h>
+    #include <climits>
+#endif
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <fcntl.h>
+#endif
+
+// The directories of --scan
+#if defined(_WIN32) && !defined(_WON32)
+    #define RGUID_DIR_WIN32
+#elif defined(__unix__) || defined(__APPLE__)
+    #define RGUID_DIR_POSIX
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
+
+// io_uring (Linux 5.6 or later for openat, statx, read and close) to read the small files in batches
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #if defined(IORING_FEAT_RW_CUR_POS) && defined(STATX_SIZE)
+            #define RGUID_IO_URING
+            #include <sys/mman.h>
+            #include <sys/syscall.h>
+            #include <fcntl.h>
+        #endif
+    #endif
+#endif
 
 #if !defined(_WIN32) || defined(_WON32)
 DEFINE_GUID(IID_IShellLinkW, 0x000214F9, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);
 #else
-#include <shlobj.h>
+#include <shlobj.h>
+#endif
+
+GuidDataBase g_database;
+bool g_bSearch = false;
+bool g_bList = false;
+bool g_bDefOnly = false;
+bool g_bGuidOnly = false;
+bool g_bStructOnly = false;
+bool g_bHexOnly = false;
+int g_nGenerate = 0;
+bool g_bGenerateV7 = false;
+int g_nThreads = 0; // 0 unless --threads
+int g_nNameVersion = 0; // 5 or 3 for name-based GUIDs
+std::string g_strNamespace, g_strNamesFile;
+bool g_bScan = false;
+bool g_bScanBinary = false;
+std::vector<std::string> g_strScanFiles; // in UTF-8
+std::vector<std::string> g_strIncludes, g_strExcludes;
+std::string g_strScanCache;
+bool g_bCompile = false;
+std::string g_strCompileFrom, g_strCompileTo;
+
+
+void show_version(void)
+{
+    std::puts(GUID_VERSION);
+}
+
+void usage(void)
+{
+    std::printf(
+        "rguid --- The GUID analyzer."
+        "\n"
+        "Usage:\n"
+        "  rguid --search \"STRING\"\n"
+        "  rguid IID_IDeskBand\n"
+        "  rguid \"{EB0FE172-1A3A-11D0-89B3-00A0C90A90AC}\"\n"
+        "  rguid \"72 E1 0F EB 3A 1A D0 11 89 B3 00 A0 C9 0A 90 AC\"\n"
+        "  rguid \"{ 0xEB0FE172, 0x1A3A, 0x11D0, { 0x89, 0xB3, 0x00, 0xA0, 0xC9, 0x0A,\n"
+        "            0x90, 0xAC } }\"\n"
+        "  rguid \"DEFINE_GUID(IID_IDeskBand, 0xEB0FE172, 0x1A3A, 0x11D0, 0x89, 0xB3,\n"
+        "                      0x00, 0xA0, 0xC9, 0x0A, 0x90, 0xAC);\"\n"
+        "  rguid --list\n"
+        "  rguid --generate NUMBER\n"
+        "  rguid --generate-v7 NUMBER\n"
+        "  rguid --generate NUMBER --threads THREADS\n"
+        "  rguid --generate-v5 NAMESPACE [NAMES_FILE]\n"
+        "  rguid --generate-v3 NAMESPACE [NAMES_FILE]\n"
+        "  rguid --scan \"YOUR_FILE_1\" \"YOUR_FILE_2\" ...\n"
+        "  rguid --scan-binary \"YOUR_FILE_1\" \"YOUR_FILE_2\" ...\n"
+        "  rguid --scan DIRECTORY --include GLOB --exclude GLOB --threads THREADS\n"
+        "  rguid --scan DIRECTORY --cache FILE\n"
+        "  rguid --compile guid.dat guid.bin\n"
+        "  rguid --help\n"
+        "  rguid --version\n"
+        "\n"
+        "You can specify multiple GUIDs.\n"
+        "NAMESPACE is dns, url, oid, x500, a GUID or a name. Names are read from the lines of\n"
+        "NAMES_FILE, or stdin if omitted or \"-\". Blank lines are skipped.\n"
+        "--scan and --scan-binary read stdin for \"-\". --scan-binary finds the GUIDs of the\n"
+        "database in binary files such as executables and registry hives.\n"
+        "A directory is scanned recursively on all CPUs unless --threads. GLOB matches the name,\n"
+        "or the relative path if it has '/'. '*' and '?' don't match '/' but '**' does.\n"
+        "--cache FILE keeps what is found in each file, to scan only the changed files next time.\n"
+        "Use --def-only, --guid-only, --struct-only or --hex-only for one format.\n");
+}
+
+// Matches a glob of '*', '**' and '?', where only '**' matches '/'. Case-insensitive on Windows
+static bool glob_match(const char *pattern, const char *text)
+{
+    for (; *pattern; ++pattern, ++text)
+    {
+        if (*pattern == '*')
+        {
+            bool any = (pattern[1] == '*');
+            while (*pattern == '*')
+                ++pattern;
+            if (any && *pattern == '/' && glob_match(pattern + 1, text))
+                return true; // "**/" matches no directory too
+            for (;; ++text)
+            {
+                if (glob_match(pattern, text))
+                    return true;
+                if (!*text || (!any && *text == '/'))
+                    return false;
+            }
+        }
+
+        char ch1 = *pattern, ch2 = *text;
+#ifdef _WIN32
+        ch1 = (ch1 == '\\') ? '/' : (char)tolower((uint8_t)ch1);
+        ch2 = (ch2 == '\\') ? '/' : (char)tolower((uint8_t)ch2);
+#endif
+        if (!ch2 || (ch1 == '?' ? ch2 == '/' : ch1 != ch2))
+            return false;
+    }
+    return !*text;
+}
+
+static inline uint64_t hash_rotl(uint64_t x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+// A fast 64-bit hash of the contents in four lanes, not cryptographic
+static uint64_t content_hash(const void *ptr, size_t size, uint64_t seed = 0)
+{
+    const uint64_t K1 = 0x9E3779B97F4A7C15, K2 = 0xC2B2AE3D27D4EB4F;
+    const uint8_t *pb = (const uint8_t *)ptr;
+    uint64_t lanes[4] = { seed + K1 + K2, seed + K2, seed, seed - K1 };
+    uint64_t word, hash = seed ^ (size * K1);
+
+    for (; size >= 32; pb += 32, size -= 32)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            memcpy(&word, pb + 8 * i, 8);
+            lanes[i] = hash_rotl(lanes[i] + word * K2, 31) * K1;
+        }
+    }
+    for (int i = 0; i < 4; ++i)
+        hash = hash_rotl(hash ^ lanes[i], 27) * K1 + K2;
+
+    for (; size >= 8; pb += 8, size -= 8)
+    {
+        memcpy(&word, pb, 8);
+        hash = hash_rotl(hash ^ (hash_rotl(word * K2, 31) * K1), 27) * K1 + K2;
+    }
+    for (; size > 0; ++pb, --size)
+        hash = hash_rotl(hash ^ (*pb * K1), 11) * K2;
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCD;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+typedef enum RET
+{
+    RET_DONE = 0,
+    RET_FAILED = -1,
+    RET_SUCCESS = +1,
+} RET;
+
+void do_unittest(void)
+{
+#ifndef NDEBUG
+    GUID guid = IID_IShellLinkW;
+
+    // The built-in database if no guid.dat
+    bool loaded = g_database.load(L"guid.dat");
+#ifdef RGUID_EMBED_DATABASE
+    if (!loaded)
+        assert(g_database.load_embedded());
+#else
+    assert(loaded);
+#endif
+
+    GUID_FOUND found;
+    assert(g_database.search_by_name(found, L"IID_IShellLinkW"));
+    assert(found.size() >= 1);
+    assert(found[0].name == "IID_IShellLinkW");
+    assert(guid_equal(found[0].guid, IID_IShellLinkW));
+
+    found.clear();
+    assert(g_database.search_by_guid(found, guid));
+    assert(found.size() >= 1);
+    assert(found[0].name == "IID_IShellLinkW");
+    assert(guid_equal(found[0].guid, IID_IShellLinkW));
+
+    auto define_guid = guid_to_definition(guid, NULL);
+    assert(define_guid ==
+        L"DEFINE_GUID(<Name>, 0x000214F9, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);");
+    assert(guid_is_definition(define_guid.c_str()));
+
+    auto guid_text = guid_to_guid_text(guid);
+    assert(guid_text == L"{000214F9-0000-0000-C000-000000000046}");
+    assert(guid_is_guid_text(guid_text.c_str()));
+
+    GUID guid2;
+    assert(guid_decode_guid_text(guid2, "{000214f9-0000-0000-c000-000000000046}"));
+    assert(guid_equal(guid2, guid));
+    assert(!guid_decode_guid_text(guid2, L"{000214F9-0000-0000-C000-00000000004G}"));
+    const char bare[] = "id=000214F9-0000-0000-c000-000000000046;";
+    assert(guid_find_bare_text(bare, bare + sizeof(bare) - 1) == bare + 3);
+    assert(guid_decode_bare_text(guid2, bare + 3) && guid_equal(guid2, guid));
+    assert(!guid_find_bare_text(bare + 4, bare + sizeof(bare) - 1));
+
+    auto hex_text = guid_to_hex_text(guid);
+    assert(hex_text == L"F9 14 02 00 00 00 00 00 C0 00 00 00 00 00 00 46");
+    assert(guid_is_hex_text(hex_text.c_str()));
+
+    auto struct_text = guid_to_struct_text(guid);
+    assert(struct_text == L"{ 0x000214F9, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } }");
+    assert(guid_is_struct_text(struct_text.c_str()));
+
+    assert(guid_classify(" {000214F9-", 11) == GUID_FORMAT_GUID_TEXT);
+    assert(guid_classify("{ 0x000214F9", 12) == GUID_FORMAT_STRUCT_TEXT);
+    assert(guid_classify("/**/DEFINE_OLEGUID(", 19) == GUID_FORMAT_DEFINITION);
+    assert(guid_classify("F9 14", 5) == GUID_FORMAT_HEX_TEXT);
+    assert(guid_parse(guid2, " {000214F9-0000-0000-C000-000000000046}\n", 40) == GUID_FORMAT_GUID_TEXT);
+    assert(guid_equal(guid2, guid));
+    assert(guid_parse(guid2, "F9 14 02 00 00 00 00 00 C0 00 00 00 00 00 00 46", 47) == GUID_FORMAT_HEX_TEXT);
+    assert(guid_equal(guid2, guid));
+    {
+        const char bytes[] = "{0xF9, 0x14, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46}";
+        assert(guid_parse(guid2, bytes, sizeof(bytes) - 1) == GUID_FORMAT_HEX_TEXT);
+        assert(guid_equal(guid2, guid));
+    }
+    assert(guid_parse(guid2, "{000214F9-0000-0000-C000-000000000046", 37, GUID_FORMAT_GUID_TEXT) == GUID_FORMAT_UNKNOWN);
+
+    char text[128];
+    assert(guid_format_guid_text(text, guid) == GUID_TEXT_LENGTH);
+    assert(strcmp(text, "{000214F9-0000-0000-C000-000000000046}") == 0);
+    assert(guid_format_definition(text, 16, guid, "IID_IShellLinkW") == 105);
+    assert(guid_format_definition(text, sizeof(text), guid, "") == 96);
+    assert(strncmp(text, "DEFINE_GUID(<Name>, 0x000214F9, ", 32) == 0);
+
+    std::string name;
+    assert(guid_from_definition(guid2, "DEFINE_OLEGUID(IID_X, 0x000214F9, 0, 0);", &name));
+    assert(guid_equal(guid2, guid) && name == "IID_X");
+    assert(guid_from_definition(guid2, "MIDL_DEFINE_GUID(IID, IID_Y,0x000214F9,0,0,0xC0,0,0,0,0,0,0,0x46);", &name));
+    assert(guid_equal(guid2, guid) && name == "IID_Y");
+    assert(guid_from_definition(guid2, "DEFINE_CODECAPI_GUID(Z, \"x\", 0x000214F9L, 0, 0, 0xC0, 0, 0, 0, 0, 0, 0, 0x46) // Z", &name));
+    assert(guid_equal(guid2, guid) && name == "Z");
+    assert(!guid_from_definition(guid2, "DEFINE_GUID(X, 0x000214F9, 0, 0, 0xC0, 0, 0, 0, 0, 0, 0, 0x46) X"));
+    assert(!guid_from_definition(guid2, "DEFINE_GUID(X, 0x000214F9, 0, 0, 0xC0, 0, 0, 0, 0, 0, 0x46)"));
+    assert(guid_parse(guid2, "{ 0x000214F9, 0, 0, { 0xC0, 0, 0, 0, 0, 0, 0, 0x46 } }"));
+    assert(guid_equal(guid2, guid));
+    assert(guid_from_struct_text(guid2, "{0x000214F9,0,0,0xC0,0,0,0,0,0,0,0x46,}; // flat"));
+    assert(guid_equal(guid2, guid));
+    assert(!guid_from_struct_text(guid2, "{ 0x000214F9, 0, 0, { 0xC0, 0, 0, 0, 0, 0, 0 } }"));
+    assert(!guid_from_struct_text(guid2, "{ 0x000214F9, 0, 0, { 0xC0, 0, 0, 0, 0, 0, 0, 0x46 }"));
+    assert(guid_to_definition_a(guid, "IID_X") == "DEFINE_GUID(IID_X, 0x000214F9, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);");
+    assert(guid_ansi_from_wide(L"\x20AC", CP_UTF8) == "\xE2\x82\xAC");
+    assert(guid_wide_from_ansi("\xE2\x82\xAC", CP_UTF8) == L"\x20AC");
+    found.clear();
+    assert(g_database.search_by_name(found, "iid_ishelllinkw"));
+    assert(found[0].name == "IID_IShellLinkW");
+
+    std::vector<uint8_t> image;
+    assert(guid_db_build(image, &g_database.data()));
+    GUID_DB db;
+    assert(guid_db_attach(db, image.data(), image.size()));
+    assert(db.count == g_database.size());
+    found.clear();
+    assert(guid_db_search_by_guid(found, db, guid));
+    assert(found[0].name == "IID_IShellLinkW");
+    assert(guid_db_find(db, guid) != GUID_DB_NOT_FOUND);
+    assert(guid_equal(db.records[guid_db_find(db, guid)].guid, guid));
+    for (uint32_t i = 0; i < db.count; ++i)
+    {
+        uint32_t index = guid_db_find(db, db.records[i].guid);
+        assert(index <= i && guid_equal(db.records[index].guid, db.records[i].guid));
+    }
+    assert(guid_db_find_name(db, "iid_ishelllinkw") == guid_db_find(db, guid));
+    assert(guid_db_find_name(db, "IID_IShellLink") == GUID_DB_NOT_FOUND);
+    found.clear();
+    assert(guid_db_search_by_text(found, db, L"000214f9-0000"));
+    assert(found.size() == 1 && found[0].name == "IID_IShellLinkW");
+    found.clear();
+    assert(!guid_db_search_by_text(found, db, L"IID_IShellLinkQ"));
+    assert(db.source_size == 0 && guid_db_is_stale(db, "guid.dat") == loaded);
+    assert(!guid_db_is_stale(db, "no such file"));
+    image[0] = 0;
+    assert(!guid_db_attach(db, image.data(), image.size()));
+
+    // ChaCha20 with the zero key and nonce (RFC 7539 A.1)
+    static const uint8_t zero_key[32] = { 0 };
+    static const uint8_t keystream[16] =
+    {
+        0x76, 0xB8, 0xE0, 0xAD, 0xA0, 0xF1, 0x3D, 0x90, 0x40, 0x5D, 0x6A, 0xE5, 0x53, 0x86, 0xBD, 0x28,
+    };
+    GUID_RANDOM rng;
+    uint8_t bytes[1000], bytes2[1000];
+    guid_random_init(rng, zero_key, 0);
+    guid_random_fill(rng, bytes, sizeof(bytes));
+    assert(memcmp(bytes, keystream, sizeof(keystream)) == 0);
+    guid_random_init(rng, zero_key, 0);
+    guid_random_fill(rng, bytes2, 7);
+    guid_random_fill(rng, bytes2 + 7, 300);
+    guid_random_fill(rng, bytes2 + 307, sizeof(bytes2) - 307);
+    assert(memcmp(bytes, bytes2, sizeof(bytes)) == 0);
+
+    GUID guids[33];
+    assert(guid_random_init(rng));
+    guid_random_generate(rng, guids, _countof(guids));
+    for (auto& item : guids)
+        assert((item.Data3 >> 12) == 4 && (item.Data4[0] & 0xC0) == 0x80);
+    assert(!guid_equal(guids[0], guids[1]));
+    assert(guid_random_generate(guid) && (guid.Data3 >> 12) == 4);
+
+    // Version 7 increases within a millisecond, and when the clock goes back
+    GUID_V7 gen;
+    assert(guid_v7_init(gen));
+    guid_generate_v7(gen, guids, 16);
+    gen.last_ms += 1000;
+    guid_generate_v7(gen, guids + 16, 16);
+    gen.counter = (uint64_t(1) << 42) - 1;
+    guid_generate_v7(gen, guids + 32, 1);
+    for (size_t i = 0; i < _countof(guids); ++i)
+    {
+        assert((guids[i].Data3 >> 12) == 7 && (guids[i].Data4[0] & 0xC0) == 0x80);
+        if (i > 0)
+            assert(guid_to_guid_text_a(guids[i - 1]) < guid_to_guid_text_a(guids[i]));
+    }
+    assert(guid_generate_v7(guid) && (guid.Data3 >> 12) == 7);
+
+    // More than the capacity, to take the synchronous way too
+    {
+        GuidReservoir reservoir(16);
+        std::vector<std::string> texts;
+        for (int i = 0; i < 1000; ++i)
+        {
+            assert(reservoir.take(guid) && (guid.Data3 >> 12) == 4);
+            texts.push_back(guid_to_guid_text_a(guid));
+        }
+        std::sort(texts.begin(), texts.end());
+        assert(std::unique(texts.begin(), texts.end()) == texts.end());
+        assert(reservoir.size() <= 16);
+    }
+
+    // Versions 5 and 3 (RFC 9562 A.2 and A.4)
+    guid_generate_v5(guid, GUID_NAMESPACE_DNS, "www.example.com", 15);
+    assert(guid_to_guid_text_a(guid) == "{2ED6657D-E927-568B-95E1-2665A8AEA6A2}");
+    guid_generate_v3(guid, GUID_NAMESPACE_DNS, "www.example.com", 15);
+    assert(guid_to_guid_text_a(guid) == "{5DF41881-3AED-3515-88A7-2F4A814CF09E}");
+    const char *names[] = { "a", "www.example.com", "", "bc", "0123456789012345678901234567890123456789012345678" };
+    size_t lengths[_countof(names)];
+    for (size_t i = 0; i < _countof(names); ++i)
+        lengths[i] = strlen(names[i]);
+    guid_generate_v5(guids, GUID_NAMESPACE_URL, names, lengths, _countof(names));
+    for (size_t i = 0; i < _countof(names); ++i)
+    {
+        guid_generate_v5(guid, GUID_NAMESPACE_URL, names[i], lengths[i]);
+        assert(guid_equal(guid, guids[i]));
+    }
+    guid_generate_v3(guids, GUID_NAMESPACE_URL, names, lengths, _countof(names));
+    for (size_t i = 0; i < _countof(names); ++i)
+    {
+        guid_generate_v3(guid, GUID_NAMESPACE_URL, names[i], lengths[i]);
+        assert(guid_equal(guid, guids[i]));
+    }
+    {
+        // The same name in all of the four lanes of MD5
+        const char *dns[4] = { "python.org", "python.org", "python.org", "python.org" };
+        size_t cch[4] = { 10, 10, 10, 10 };
+        guid_generate_v3(guids, GUID_NAMESPACE_DNS, dns, cch, 4);
+        guid_generate_v3(guid, GUID_NAMESPACE_DNS, dns[0], cch[0]);
+        assert(guid_to_guid_text_a(guid) == "{6FA459EA-EE8A-3CA4-894E-DB77E160355E}");
+        for (size_t i = 0; i < 4; ++i)
+            assert(guid_equal(guids[i], guid));
+    }
+
+    // Scanning UTF-8 and UTF-16LE, with a NUL between and keywords overlapping
+    {
+        const char text[] = "DEFINE_GUID(IID_X, 0x000214F9, 0, 0, 0xC0, 0, 0, 0, 0, 0, 0, 0x46);\0"
+                            "{{000214F9-0000-0000-C000-000000000046}}"
+                            "MIDL_DEFINE_GUID(CLSID, IID_Y, 0x000214F9, 0, 0, 0xC0, 0, 0, 0, 0, 0, 0, 0x46);";
+        std::vector<uint8_t> utf16 = { 0xFF, 0xFE };
+        for (size_t i = 0; i < sizeof(text) - 1; ++i)
+        {
+            utf16.push_back(text[i]);
+            utf16.push_back(0);
+        }
+        GUID_FOUND found;
+        assert(guid_scan_memory(found, text, sizeof(text) - 1) && found.size() == 3);
+        assert(found[0].name.empty() && found[1].name == "IID_X" && found[2].name == "IID_Y");
+        assert(guid_equal(found[0].guid, IID_IShellLinkW) && guid_equal(found[2].guid, IID_IShellLinkW));
+        found.clear();
+        assert(guid_scan_memory(found, utf16.data(), utf16.size()) && found.size() == 3);
+        assert(found[1].name == "IID_X" && guid_equal(found[1].guid, IID_IShellLinkW));
+
+        // Bare GUID text, but not a part of longer hex text
+        const char json[] = "{\"id\": \"000214f9-0000-0000-c000-000000000046\", "
+                            "\"x\": \"f100214f9-0000-0000-c000-000000000046\"}";
+        found.clear();
+        assert(guid_scan_memory(found, json, sizeof(json) - 1) && found.size() == 1);
+        assert(guid_equal(found[0].guid, IID_IShellLinkW));
+
+        // The GUID text in a definition is not found again
+        const char codecapi[] = "DEFINE_CODECAPI_GUID(MyFoo, \"57cbb9b8-116f-4951-b40c-c2a035ed8f99\", "
+                                "0x57cbb9b8, 0x116f, 0x4951, 0xb4, 0x0c, 0xc2, 0xa0, 0x35, 0xed, 0x8f, 0x99)";
+        found.clear();
+        assert(guid_scan_memory(found, codecapi, sizeof(codecapi) - 1) && found.size() == 1);
+        assert(found[0].name == "MyFoo");
+
+        // Over threads, with the definitions around the end of the first 4 MB window
+        std::string large(5 << 20, ' ');
+        for (int k = -2; k <= 2; ++k)
+            large.replace((4 << 20) + k * 200, sizeof(text) - 1, text, sizeof(text) - 1);
+        found.clear();
+        assert(guid_scan_memory(found, large.data(), large.size()) && found.size() == 3);
+        GUID_FOUND found2;
+        assert(guid_scan_memory(found2, large.data(), large.size(), 4) && found2.size() == 3);
+        for (size_t i = 0; i < found.size(); ++i)
+            assert(found[i].name == found2[i].name && guid_equal(found[i].guid, found2[i].guid));
+
+        // A definition from the first window into the second, with its GUID text in the second
+        std::string across(5 << 20, ' ');
+        across.replace((4 << 20) - 10, sizeof(codecapi) - 1, codecapi, sizeof(codecapi) - 1);
+        found.clear();
+        assert(guid_scan_memory(found, across.data(), across.size()) && found.size() == 1);
+        assert(found[0].name == "MyFoo");
+        found2.clear();
+        assert(guid_scan_memory(found2, across.data(), across.size(), 2) && found2.size() == 1);
+    }
+
+    // Binary data, at an odd offset, twice, with zeros for GUID_NULL
+    {
+        uint8_t binary[64] = { 0 };
+        memcpy(&binary[3], &IID_IShellLinkW, sizeof(GUID));
+        memcpy(&binary[40], &IID_IShellLinkW, sizeof(GUID));
+        GUID_FOUND found;
+        assert(g_database.scan_binary(found, binary, sizeof(binary)) && found.size() == 1);
+        assert(found[0].name == "IID_IShellLinkW");
+        found.clear();
+        assert(!g_database.scan_binary(found, binary, 3 + sizeof(GUID) - 1));
+    }
+
+    // The content hash of --cache
+    {
+        char text[100];
+        for (size_t i = 0; i < sizeof(text); ++i)
+            text[i] = (char)i;
+        uint64_t hash = content_hash(text, sizeof(text));
+        assert(hash == content_hash(text, sizeof(text)) && hash != content_hash(text, sizeof(text) - 1));
+        text[77] ^= 1;
+        assert(hash != content_hash(text, sizeof(text)));
+        text[77] ^= 1;
+        text[3] ^= 0x80;
+        assert(hash != content_hash(text, sizeof(text)));
+    }
+
+    // The globs of --include and --exclude
+    assert(glob_match("*.h", "guid.h") && !glob_match("*.h", "guid.hpp"));
+    assert(glob_match("g?id.*", "guid.cpp") && !glob_match("*.h", "include/guid.h"));
+    assert(glob_match("**/*.h", "guid.h") && glob_match("**/*.h", "sdk/include/guid.h"));
+    assert(glob_match("sdk/**", "sdk/include/guid.h") && !glob_match("sdk/*", "sdk/include/guid.h"));
+
+#ifdef RGUID_EMBED_DATABASE
+    const GUID_DB& embedded = guid_db_embedded();
+    assert(embedded.count == g_database.size());
+    assert(guid_db_find_name(embedded, "IID_IShellLinkW") == guid_db_find(embedded, IID_IShellLinkW));
+#endif
+#endif
+}
+
+// Prints "DEFINE_GUID(...);" and a newline, reusing the buffer of line
+static void print_definition(std::string& line, const GUID& guid, const char *name)
+{
+    size_t cch = guid_format_definition(&line[0], 0, guid, name);
+    line.resize(cch + 1);
+    guid_format_definition(&line[0], cch + 1, guid, name);
+    line[cch] = '\n';
+    std::fwrite(line.data(), 1, line.size(), stdout);
+}
+
+// Whether only one format is printed
+static bool is_brief(void)
+{
+    return g_bDefOnly || g_bGuidOnly || g_bStructOnly || g_bHexOnly;
+}
+
+// Appends what do_guid prints for a GUID
+static void append_guid(std::string& out, REFGUID guid, const std::string *pstrName)
+{
+    if (!is_brief())
+    {
+        out += "\n--------------------\n";
+    }
+
+    std::string name;
+    if (pstrName == NULL)
+    {
+        if (guid_db_find(g_database.db(), guid) != GUID_DB_NOT_FOUND)
+        {
+            GUID_FOUND found;
+            g_database.search_by_guid(found, guid);
+            for (auto& entry : found)
+            {
+                name = entry.name;
+                if (!is_brief())
+                {
+                    out += "Name: ";
+                    out += name;
+                    out += "\n\n";
+                }
+            }
+        }
+    }
+    else
+    {
+        name = *pstrName;
+    }
+
+    if (g_bGuidOnly)
+    {
+        char text[GUID_TEXT_LENGTH + 1];
+        size_t cch = guid_format_guid_text(text, guid);
+        text[cch++] = '\n';
+        out.append(text, cch);
+    }
+    else if (g_bStructOnly)
+    {
+        char text[GUID_STRUCT_TEXT_LENGTH + 1];
+        size_t cch = guid_format_struct_text(text, guid);
+        text[cch++] = '\n';
+        out.append(text, cch);
+    }
+    else if (g_bHexOnly)
+    {
+        char text[GUID_HEX_TEXT_LENGTH + 1];
+        size_t cch = guid_format_hex_text(text, guid);
+        text[cch++] = '\n';
+        out.append(text, cch);
+    }
+    else if (g_bDefOnly)
+    {
+        size_t pos = out.size();
+        size_t cch = guid_format_definition(NULL, 0, guid, name.c_str());
+        out.resize(pos + cch + 1);
+        guid_format_definition(&out[pos], cch + 1, guid, name.c_str());
+        out[pos + cch] = '\n';
+    }
+    else
+    {
+        out += guid_dump_a(guid, name.c_str());
+    }
+}
+
+RET do_guid(REFGUID guid, std::string *pstrName = NULL)
+{
+    std::string out;
+    append_guid(out, guid, pstrName);
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    return RET_SUCCESS;
+}
+
+#define GENERATE_BATCH 4096
+
+// The state of a worker of --generate --threads. The batches are dealt round-robin to the
+// workers. Each worker has two buffers, one filled while the other is written
+struct GENERATE_JOB
+{
+    GUID_RANDOM rng;    // its own stream
+    std::vector<GUID> guids;
+    std::string out[2];
+    bool ready[2];
+};
+
+struct GENERATE_CONTEXT
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<GENERATE_JOB> jobs;
+    GUID_V7 gen;        // shared to keep version 7 in order across batches
+    int next_v7;        // the batch to take from gen next
+    int count;
+    int batch_count;
+    bool stop;
+};
+
+static void generate_worker(GENERATE_CONTEXT *ctx, int worker)
+{
+    GENERATE_JOB& job = ctx->jobs[worker];
+    const int nJobs = (int)ctx->jobs.size();
+
+    for (int batch = worker, round = 0; batch < ctx->batch_count; batch += nJobs, ++round)
+    {
+        const int slot = (round & 1);
+        const int n = std::min(GENERATE_BATCH, ctx->count - batch * GENERATE_BATCH);
+
+        {
+            std::unique_lock<std::mutex> lock(ctx->mutex);
+            ctx->cond.wait(lock, [&] { return ctx->stop || !job.ready[slot]; });
+            if (g_bGenerateV7)
+            {
+                // Only this part is serialized; the formatting below is not
+                ctx->cond.wait(lock, [&] { return ctx->stop || ctx->next_v7 == batch; });
+                if (!ctx->stop)
+                    guid_generate_v7(ctx->gen, job.guids.data(), n);
+                ++ctx->next_v7;
+                ctx->cond.notify_all();
+            }
+            if (ctx->stop)
+                return;
+        }
+
+        if (!g_bGenerateV7)
+            guid_random_generate(job.rng, job.guids.data(), n);
+
+        std::string& out = job.out[slot];
+        out.clear();
+        for (int i = 0; i < n; ++i)
+            append_guid(out, job.guids[i], NULL);
+
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            job.ready[slot] = true;
+        }
+        ctx->cond.notify_all();
+    }
+}
+
+// Writes the buffers in order, with one system call if possible
+static bool write_buffers(const std::vector<const std::string *>& bufs)
+{
+#ifdef RGUID_WRITEV
+    std::vector<struct iovec> iov;
+    for (auto buf : bufs)
+    {
+        struct iovec item = { const_cast<char *>(buf->data()), buf->size() };
+        iov.push_back(item);
+    }
+
+    size_t i = 0;
+    while (i < iov.size())
+    {
+        int n = (int)std::min(iov.size() - i, (size_t)IOV_MAX);
+        ssize_t cb = writev(STDOUT_FILENO, &iov[i], n);
+        if (cb < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        // Skip what is written, which may end in the middle of a buffer
+        for (; i < iov.size() && (size_t)cb >= iov[i].iov_len; ++i)
+            cb -= iov[i].iov_len;
+        if (cb > 0)
+        {
+            iov[i].iov_base = (char *)iov[i].iov_base + cb;
+            iov[i].iov_len -= cb;
+        }
+    }
+    return true;
+#else
+    for (auto buf : bufs)
+    {
+        if (std::fwrite(buf->data(), 1, buf->size(), stdout) != buf->size())
+            return false;
+    }
+    return std::fflush(stdout) == 0;
+#endif
+}
+
+// Generates with the workers. The main thread writes the batches in order
+RET do_generate_parallel(int count)
+{
+    GENERATE_CONTEXT ctx;
+    ctx.jobs.resize(g_nThreads);
+    ctx.next_v7 = 0;
+    ctx.count = count;
+    ctx.batch_count = (count + GENERATE_BATCH - 1) / GENERATE_BATCH;
+    ctx.stop = false;
+    bool ok = guid_v7_init(ctx.gen);
+    for (auto& job : ctx.jobs)
+    {
+        ok = ok && guid_random_init(job.rng);
+        job.guids.resize(GENERATE_BATCH);
+        job.ready[0] = job.ready[1] = false;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "ERROR: No entropy to generate GUIDs\n");
+        return RET_FAILED;
+    }
+
+    std::fflush(stdout);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < g_nThreads; ++i)
+        threads.emplace_back(generate_worker, &ctx, i);
+
+    std::vector<const std::string *> bufs;
+    for (int batch = 0; batch < ctx.batch_count && ok; )
+    {
+        // Take the ready batches from the next one on, up to a round of both buffers
+        int first = batch;
+        bufs.clear();
+        {
+            std::unique_lock<std::mutex> lock(ctx.mutex);
+            for (;; ++batch)
+            {
+                if (batch == ctx.batch_count || batch - first == 2 * g_nThreads)
+                    break;
+                GENERATE_JOB& job = ctx.jobs[batch % g_nThreads];
+                int slot = (batch / g_nThreads) & 1;
+                if (!job.ready[slot])
+                {
+                    if (batch > first)
+                        break;
+                    ctx.cond.wait(lock, [&] { return job.ready[slot]; });
+                }
+                bufs.push_back(&job.out[slot]);
+            }
+        }
+
+        ok = write_buffers(bufs);
+
+        {
+            std::lock_guard<std::mutex> lock(ctx.mutex);
+            for (int i = first; i < batch; ++i)
+                ctx.jobs[i % g_nThreads].ready[(i / g_nThreads) & 1] = false;
+            ctx.stop = !ok;
+        }
+        ctx.cond.notify_all();
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    return ok ? RET_SUCCESS : RET_FAILED;
+}
+
+// Generates random (or time-ordered) GUIDs in batches, formatting each batch into one buffer
+RET do_generate(int count)
+{
+    if (g_nThreads > 1)
+        return do_generate_parallel(count);
+
+    GUID_V7 gen;
+    if (!guid_v7_init(gen))
+    {
+        fprintf(stderr, "ERROR: No entropy to generate GUIDs\n");
+        return RET_FAILED;
+    }
+
+    const int batch = GENERATE_BATCH;
+    std::vector<GUID> guids(batch);
+    std::string out;
+    out.reserve(batch * 128);
+    while (count > 0)
+    {
+        int n = (count < batch) ? count : batch;
+        if (g_bGenerateV7)
+            guid_generate_v7(gen, guids.data(), n);
+        else
+            guid_random_generate(gen.rng, guids.data(), n);
+
+        out.clear();
+        for (int i = 0; i < n; ++i)
+            append_guid(out, guids[i], NULL);
+        std::fwrite(out.data(), 1, out.size(), stdout);
+
+        count -= n;
+    }
+
+    return RET_SUCCESS;
+}
+
+// The namespace of name-based GUIDs
+static bool get_namespace(GUID& ns, const char *text)
+{
+    static const struct { const char *name; const GUID *guid; } s_namespaces[] =
+    {
+        { "DNS", &GUID_NAMESPACE_DNS },
+        { "URL", &GUID_NAMESPACE_URL },
+        { "OID", &GUID_NAMESPACE_OID },
+        { "X500", &GUID_NAMESPACE_X500 },
+    };
+    for (auto& item : s_namespaces)
+    {
+        size_t ich;
+        for (ich = 0; text[ich] && toupper((uint8_t)text[ich]) == item.name[ich]; ++ich)
+            ;
+        if (!text[ich] && !item.name[ich])
+        {
+            ns = *item.guid;
+            return true;
+        }
+    }
+
+    if (guid_parse(ns, text))
+        return true;
+
+    GUID_FOUND found;
+    if (!g_database.search_by_name(found, text))
+        return false;
+    ns = found[0].guid;
+    return true;
+}
+
+// Generates and prints a batch of name-based GUIDs
+static void generate_names(std::vector<const char *>& names, std::vector<size_t>& lengths, const GUID& ns)
+{
+    std::vector<GUID> guids(names.size());
+    if (g_nNameVersion == 5)
+        guid_generate_v5(guids.data(), ns, names.data(), lengths.data(), names.size());
+    else
+        guid_generate_v3(guids.data(), ns, names.data(), lengths.data(), names.size());
+
+    std::string out;
+    for (auto& guid : guids)
+        append_guid(out, guid, NULL);
+    std::fwrite(out.data(), 1, out.size(), stdout);
+
+    names.clear();
+    lengths.clear();
+}
+
+// Generates name-based GUIDs from the lines of a file or stdin
+RET do_generate_names(void)
+{
+    GUID ns;
+    if (!get_namespace(ns, g_strNamespace.c_str()))
+    {
+        fprintf(stderr, "ERROR: Invalid namespace '%s'\n", g_strNamespace.c_str());
+        return RET_FAILED;
+    }
+
+    FILE *fp = stdin;
+    if (g_strNamesFile.size() && g_strNamesFile != "-")
+    {
+        fp = fopen(g_strNamesFile.c_str(), "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "ERROR: Cannot open '%s'\n", g_strNamesFile.c_str());
+            return RET_FAILED;
+        }
+    }
+
+    // Read in chunks. The last line of a chunk waits for the next chunk unless at the end
+    std::vector<char> buf(1 << 20);
+    std::vector<const char *> names;
+    std::vector<size_t> lengths;
+    size_t len = 0;
+    for (bool eof = false; !eof; )
+    {
+        if (len == buf.size())
+            buf.resize(buf.size() * 2); // a line longer than the buffer
+
+        size_t cb = fread(&buf[len], 1, buf.size() - len, fp);
+        eof = (cb < buf.size() - len);
+        len += cb;
+
+        size_t end = len;
+        if (!eof)
+        {
+            while (end > 0 && buf[end - 1] != '\n')
+                --end;
+        }
+
+        for (size_t ich = 0; ich < end; )
+        {
+            size_t next = ich;
+            while (next < end && buf[next] != '\n')
+                ++next;
+            if (next == end && next == ich)
+                break; // no more line
+
+            size_t cch = next - ich;
+            if (cch > 0 && buf[ich + cch - 1] == '\r')
+                --cch;
+            if (cch > 0) // a blank line is skipped
+            {
+                names.push_back(&buf[ich]);
+                lengths.push_back(cch);
+                if (names.size() == GENERATE_BATCH)
+                    generate_names(names, lengths, ns);
+            }
+
+            ich = next + 1;
+        }
+        if (names.size())
+            generate_names(names, lengths, ns);
+
+        memmove(&buf[0], &buf[end], len - end);
+        len -= end;
+    }
+
+    if (fp != stdin)
+        fclose(fp);
+    return RET_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// --scan
+
+// A file or a directory to scan. The path is in UTF-8
+struct SCAN_TASK
+{
+    std::string path;
+    size_t root;        // the length of the argument that the path is under, for the globs
+    bool dir;
+    bool listed;        // found in a directory
+};
+
+// What was found in a file that was scanned. The file is not read again while the size and the
+// time are the same, and not scanned again while the contents are
+struct SCAN_CACHE_FILE
+{
+    uint64_t size;
+    int64_t mtime;      // in the units of the platform
+    uint64_t hash;      // content_hash of the contents
+    GUID_FOUND found;   // without the names from the database
+};
+
+typedef std::unordered_map<std::string, SCAN_CACHE_FILE> SCAN_CACHE;
+
+// The worker takes the tasks from the back of its own queue and the others steal from the
+// front. What is found in the files is merged at the end
+struct SCAN_WORKER
+{
+    std::mutex mutex;
+    std::deque<SCAN_TASK> tasks;
+    GUID_FOUND found;
+    std::vector<std::pair<std::string, SCAN_CACHE_FILE>> cache; // of the files scanned
+};
+
+struct SCAN_CONTEXT
+{
+    std::vector<SCAN_WORKER> workers;
+    std::atomic<size_t> queued;     // the tasks in the queues
+    std::atomic<size_t> pending;    // the tasks in the queues or running
+    std::atomic<int> idle;          // the workers waiting for the tasks
+    std::mutex mutex;
+    std::condition_variable cond;
+    SCAN_CACHE cache;               // loaded, read-only while scanning
+    int threads;                    // for a large file, 1 unless the only file
+
+    SCAN_CONTEXT(int count) : workers(count), queued(0), pending(0), idle(0), threads(1)
+    {
+    }
+};
+
+static bool is_directory(const std::string& path)
+{
+#ifdef RGUID_DIR_WIN32
+    DWORD attrs = GetFileAttributesW(guid_wide_from_ansi(path.c_str(), CP_UTF8).c_str());
+    return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+#elif defined(RGUID_DIR_POSIX)
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#else
+    return false;
+#endif
+}
+
+// Whether to go into the directory or to scan the file
+static bool scan_filter(const SCAN_TASK& task)
+{
+    const char *path = task.path.c_str() + task.root;
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    for (auto& glob : g_strExcludes)
+    {
+        if (glob_match(glob.c_str(), strchr(glob.c_str(), '/') ? path : name))
+            return false;
+    }
+
+    if (task.dir || g_strIncludes.empty())
+        return true;
+
+    for (auto& glob : g_strIncludes)
+    {
+        if (glob_match(glob.c_str(), strchr(glob.c_str(), '/') ? path : name))
+            return true;
+    }
+    return false;
+}
+
+// Lists the directory into tasks. The symbolic links to directories are not followed
+static void read_directory(std::vector<SCAN_TASK>& tasks, const SCAN_TASK& dir)
+{
+    SCAN_TASK task;
+    task.root = dir.root;
+    task.listed = true;
+    std::string prefix = dir.path;
+    if (prefix.size() && prefix.back() != '/' && prefix.back() != '\\')
+        prefix += '/';
+
+#ifdef RGUID_DIR_WIN32
+    WIN32_FIND_DATAW find;
+    std::wstring spec = guid_wide_from_ansi(prefix.c_str(), CP_UTF8) + L"*";
+    HANDLE hFind = FindFirstFileW(spec.c_str(), &find);
+    if (hFind == INVALID_HANDLE_VALUE)
+        return;
+    do
+    {
+        const wchar_t *name = find.cFileName;
+        if (name[0] == L'.' && (!name[1] || (name[1] == L'.' && !name[2])))
+            continue;
+
+        task.dir = !!(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+        if (task.dir && (find.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+            continue;
+
+        task.path = prefix + guid_ansi_from_wide(name, CP_UTF8);
+        if (scan_filter(task))
+            tasks.push_back(task);
+    } while (FindNextFileW(hFind, &find));
+    FindClose(hFind);
+#elif defined(RGUID_DIR_POSIX)
+    DIR *pdir = opendir(dir.path.c_str());
+    if (!pdir)
+        return;
+    while (struct dirent *entry = readdir(pdir))
+    {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+
+        task.path = prefix + name;
+        if (entry->d_type == DT_DIR || entry->d_type == DT_REG)
+        {
+            task.dir = (entry->d_type == DT_DIR);
+        }
+        else
+        {
+            struct stat st;
+            if (lstat(task.path.c_str(), &st) != 0)
+                continue;
+            bool link = S_ISLNK(st.st_mode);
+            if (link && stat(task.path.c_str(), &st) != 0)
+                continue;
+            if (S_ISDIR(st.st_mode) ? link : !S_ISREG(st.st_mode))
+                continue;
+            task.dir = S_ISDIR(st.st_mode);
+        }
+
+        if (scan_filter(task))
+            tasks.push_back(task);
+    }
+    closedir(pdir);
+#endif
+}
+
+// A large file is split over the threads too
+static void scan_file(GUID_FOUND& found, const std::string& path, int threads)
+{
+#ifdef RGUID_DIR_WIN32
+    std::wstring wide = guid_wide_from_ansi(path.c_str(), CP_UTF8);
+    if (g_bScanBinary)
+        g_database.scan_binary_file(found, wide.c_str(), threads);
+    else
+        guid_scan_file_w(found, wide.c_str(), threads);
+#else
+    if (g_bScanBinary)
+        g_database.scan_binary_file(found, path.c_str(), threads);
+    else
+        guid_scan_file_a(found, path.c_str(), threads);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// --scan --cache
+
+#define SCAN_CACHE_MAGIC "RGUIDSC"
+#define SCAN_CACHE_VERSION 1
+
+// The header of the cache file. Each file follows as:
+//     uint32_t path_length; char path[path_length];
+//     uint64_t size; int64_t mtime; uint64_t hash; uint32_t count;
+//     count * { GUID guid; uint32_t name_length; char name[name_length]; }
+struct SCAN_CACHE_HEADER
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t binary;    // by --scan-binary
+    uint64_t stamp;     // the hash of the database for --scan-binary
+    uint64_t count;     // the number of the files
+};
+
+// The size and the last write time of a regular file
+static bool get_file_stamp(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+#ifdef RGUID_DIR_WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    std::wstring wide = guid_wide_from_ansi(path.c_str(), CP_UTF8);
+    if (!GetFileAttributesExW(wide.c_str(), GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return false;
+    }
+    size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    mtime = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+                      data.ftLastWriteTime.dwLowDateTime);
+    return true;
+#elif defined(RGUID_DIR_POSIX)
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+static const void *map_file(const std::string& path, size_t *psize)
+{
+#ifdef RGUID_DIR_WIN32
+    return guid_map_file_w(guid_wide_from_ansi(path.c_str(), CP_UTF8).c_str(), psize);
+#else
+    return guid_map_file_a(path.c_str(), psize);
+#endif
+}
+
+// The database that --scan-binary results depend on
+static uint64_t database_stamp(void)
+{
+    const GUID_DB& db = g_database.db();
+    uint64_t hash = content_hash(db.names, db.names_size);
+    return content_hash(db.records, db.count * sizeof(GUID_DB_RECORD), hash);
+}
+
+// A broken or outdated cache is the same as none
+static void load_scan_cache(SCAN_CACHE& cache, const std::string& fname, uint64_t stamp)
+{
+    size_t size;
+    const void *ptr = map_file(fname, &size);
+    if (!ptr)
+        return;
+
+    const uint8_t *pb = (const uint8_t *)ptr, *end = pb + size;
+    auto read = [&](void *data, size_t cb) {
+        if ((size_t)(end - pb) < cb)
+            return false;
+        memcpy(data, pb, cb);
+        pb += cb;
+        return true;
+    };
+    auto read_string = [&](std::string& str) {
+        uint32_t cch;
+        if (!read(&cch, sizeof(cch)) || (size_t)(end - pb) < cch)
+            return false;
+        str.assign((const char *)pb, cch);
+        pb += cch;
+        return true;
+    };
+
+    SCAN_CACHE_HEADER header;
+    bool ok = read(&header, sizeof(header)) &&
+              memcmp(header.magic, SCAN_CACHE_MAGIC, sizeof(SCAN_CACHE_MAGIC)) == 0 &&
+              header.version == SCAN_CACHE_VERSION &&
+              header.binary == (uint32_t)g_bScanBinary && header.stamp == stamp;
+    for (uint64_t i = 0; ok && i < header.count; ++i)
+    {
+        std::string path;
+        SCAN_CACHE_FILE file;
+        uint32_t count;
+        ok = read_string(path) && read(&file.size, sizeof(file.size)) &&
+             read(&file.mtime, sizeof(file.mtime)) && read(&file.hash, sizeof(file.hash)) &&
+             read(&count, sizeof(count)) && count <= (size_t)(end - pb) / (sizeof(GUID) + 4);
+        if (ok)
+            file.found.resize(count);
+        for (uint32_t k = 0; ok && k < count; ++k)
+            ok = read(&file.found[k].guid, sizeof(GUID)) && read_string(file.found[k].name);
+        if (ok)
+            cache[path] = std::move(file);
+    }
+    if (!ok || pb != end)
+        cache.clear();
+
+    guid_unmap_file(ptr, size);
+}
+
+static bool save_scan_cache(const std::vector<SCAN_WORKER>& workers, const std::string& fname,
+                            uint64_t stamp)
+{
+    // In the order of the paths, so that the same files make the same cache
+    std::vector<const std::pair<std::string, SCAN_CACHE_FILE> *> files;
+    for (auto& worker : workers)
+    {
+        for (auto& item : worker.cache)
+            files.push_back(&item);
+    }
+    std::sort(files.begin(), files.end(), [](const std::pair<std::string, SCAN_CACHE_FILE> *x,
+                                             const std::pair<std::string, SCAN_CACHE_FILE> *y) {
+        return x->first < y->first;
+    });
+
+    std::string out;
+    auto write = [&](const void *data, size_t cb) {
+        out.append((const char *)data, cb);
+    };
+    auto write_string = [&](const std::string& str) {
+        uint32_t cch = (uint32_t)str.size();
+        write(&cch, sizeof(cch));
+        write(str.data(), cch);
+    };
+
+    SCAN_CACHE_HEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCAN_CACHE_MAGIC, sizeof(SCAN_CACHE_MAGIC));
+    header.version = SCAN_CACHE_VERSION;
+    header.binary = g_bScanBinary;
+    header.stamp = stamp;
+    header.count = files.size();
+    write(&header, sizeof(header));
+    for (auto item : files)
+    {
+        const SCAN_CACHE_FILE& file = item->second;
+        uint32_t count = (uint32_t)file.found.size();
+        write_string(item->first);
+        write(&file.size, sizeof(file.size));
+        write(&file.mtime, sizeof(file.mtime));
+        write(&file.hash, sizeof(file.hash));
+        write(&count, sizeof(count));
+        for (auto& entry : file.found)
+        {
+            write(&entry.guid, sizeof(GUID));
+            write_string(entry.name);
+        }
+    }
+
+#ifdef RGUID_DIR_WIN32
+    FILE *fp = _wfopen(guid_wide_from_ansi(fname.c_str(), CP_UTF8).c_str(), L"wb");
+#else
+    FILE *fp = fopen(fname.c_str(), "wb");
+#endif
+    if (!fp)
+        return false;
+    bool ok = (fwrite(out.data(), out.size(), 1, fp) == 1);
+    if (fclose(fp) != 0)
+        ok = false;
+    return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Reading the files in batches
+
+#define SCAN_BATCH          32
+#define SCAN_BATCH_READ     ((size_t)64 * 1024)     // a larger file is mapped
+
+// A file of a batch. If not read, the file is mapped or streamed by itself
+struct SCAN_FILE
+{
+    const std::string *path;
+    const uint8_t *data;
+    size_t size;
+    bool regular;                   // found in a directory, not a pipe or a device
+    bool read;
+    bool stamped;                   // file.size and file.mtime are got for --cache
+    SCAN_CACHE_FILE file;
+    const SCAN_CACHE_FILE *old;     // in the cache
+};
+
+// Reads the small files of a batch whole with io_uring, with a system call each for the opens,
+// the reads and the closes of all of them, instead of a few for each file. Without io_uring,
+// or if the kernel doesn't support it, no file is read here
+struct SCAN_READER
+{
+    std::vector<uint8_t> buffer;    // SCAN_BATCH_READ bytes for each file
+#ifdef RGUID_IO_URING
+    int ring;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    io_uring_sqe *sqes;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe *cqes;
+    unsigned queued;
+
+    SCAN_READER() : ring(-1), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sqes(NULL), queued(0)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        // An open and a statx for each file of a batch
+        ring = (int)syscall(__NR_io_uring_setup, 2 * SCAN_BATCH, &params);
+        if (ring < 0)
+            return;
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP);
+        if (single)
+            sq_size = cq_size = std::max(sq_size, cq_size);
+
+        sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                      IORING_OFF_SQ_RING);
+        if (single)
+            cq_ptr = sq_ptr;
+        else if (sq_ptr != MAP_FAILED)
+            cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                          IORING_OFF_CQ_RING);
+        void *ptr = MAP_FAILED;
+        if (cq_ptr != MAP_FAILED)
+            ptr = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                       IORING_OFF_SQES);
+        if (ptr == MAP_FAILED)
+        {
+            close_ring();
+            return;
+        }
+
+        uint8_t *sq = (uint8_t *)sq_ptr, *cq = (uint8_t *)cq_ptr;
+        sqes = (io_uring_sqe *)ptr;
+        sq_tail = (unsigned *)(sq + params.sq_off.tail);
+        sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+        sq_array = (unsigned *)(sq + params.sq_off.array);
+        cq_head = (unsigned *)(cq + params.cq_off.head);
+        cq_tail = (unsigned *)(cq + params.cq_off.tail);
+        cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+        buffer.resize(SCAN_BATCH * SCAN_BATCH_READ);
+    }
+
+    ~SCAN_READER()
+    {
+        close_ring();
+    }
+
+    void close_ring()
+    {
+        if (sqes)
+            munmap(sqes, sqes_size);
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+            munmap(cq_ptr, cq_size);
+        if (sq_ptr != MAP_FAILED)
+            munmap(sq_ptr, sq_size);
+        if (ring >= 0)
+            ::close(ring);
+        ring = -1;
+        sq_ptr = cq_ptr = MAP_FAILED;
+        sqes = NULL;
+    }
+
+    io_uring_sqe *queue(uint8_t opcode, int fd, uint64_t index)
+    {
+        unsigned tail = *sq_tail + queued++;
+        unsigned slot = tail & *sq_mask;
+        io_uring_sqe *sqe = &sqes[slot];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = index;
+        sq_array[slot] = slot;
+        return sqe;
+    }
+
+    // Submits the queued entries and waits for all of them. results[user_data] gets each result
+    bool run(int *results)
+    {
+        unsigned count = queued, submitted = 0, done = 0;
+        queued = 0;
+        __atomic_store_n(sq_tail, *sq_tail + count, __ATOMIC_RELEASE);
+        while (done < count)
+        {
+            int ret = (int)syscall(__NR_io_uring_enter, ring, count - submitted, count - done,
+                                   IORING_ENTER_GETEVENTS, NULL, 0);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                close_ring();
+                return false;
+            }
+            submitted += ret;
+
+            unsigned head = *cq_head, tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head, ++done)
+            {
+                const io_uring_cqe *cqe = &cqes[head & *cq_mask];
+                results[cqe->user_data] = cqe->res;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+
+    void close_files(const int *fds, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fds[i] >= 0)
+                ::close(fds[i]);
+        }
+    }
+
+    void read(SCAN_FILE *files, size_t count)
+    {
+        if (ring < 0)
+            return;
+
+        // The sizes with the opens, to tell a short read from the end of a file
+        int fds[2 * SCAN_BATCH], sizes[SCAN_BATCH], closes[SCAN_BATCH];
+        int *stats = &fds[SCAN_BATCH];
+        struct statx stx[SCAN_BATCH];
+        for (size_t i = 0; i < count; ++i)
+        {
+            fds[i] = stats[i] = -1;
+            if (!files[i].regular)
+                continue;
+            io_uring_sqe *sqe = queue(IORING_OP_OPENAT, AT_FDCWD, i);
+            sqe->addr = (uint64_t)(uintptr_t)files[i].path->c_str();
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe = queue(IORING_OP_STATX, AT_FDCWD, SCAN_BATCH + i);
+            sqe->addr = (uint64_t)(uintptr_t)files[i].path->c_str();
+            sqe->len = STATX_SIZE;
+            sqe->off = (uint64_t)(uintptr_t)&stx[i];
+        }
+        if (queued && !run(fds))
+        {
+            close_files(fds, count);
+            return;
+        }
+
+        size_t opened = 0, reading = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            sizes[i] = -1;
+            if (fds[i] < 0)
+                continue;
+            ++opened;
+
+            // A larger file is mapped later
+            if (stats[i] != 0 || !(stx[i].stx_mask & STATX_SIZE) || stx[i].stx_size >= SCAN_BATCH_READ)
+                continue;
+            io_uring_sqe *sqe = queue(IORING_OP_READ, fds[i], i);
+            sqe->addr = (uint64_t)(uintptr_t)&buffer[i * SCAN_BATCH_READ];
+            sqe->len = (uint32_t)SCAN_BATCH_READ;
+            ++reading;
+        }
+        if (reading && !run(sizes))
+        {
+            close_files(fds, count);
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            closes[i] = 1;
+            if (fds[i] >= 0)
+                queue(IORING_OP_CLOSE, fds[i], i);
+        }
+        if (opened && !run(closes))
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (closes[i] > 0)
+                    closes[i] = fds[i];
+                else
+                    closes[i] = -1;
+            }
+            close_files(closes, count);
+        }
+
+        // A short read or a file changed since the size was got is read again by itself
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (0 <= sizes[i] && (uint64_t)sizes[i] == stx[i].stx_size)
+            {
+                files[i].data = &buffer[i * SCAN_BATCH_READ];
+                files[i].size = sizes[i];
+                files[i].read = true;
+            }
+        }
+
+        // An old kernel doesn't know the operations
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fds[i] == -EINVAL || stats[i] == -EINVAL)
+                close_ring();
+        }
+    }
+#else
+    void read(SCAN_FILE *files, size_t count)
+    {
+    }
 #endif
+};
 
-GuidDataBase g_database;
-bool g_bSearch = false;
-bool g_bList = false;
-bool g_bDefOnly = false;
-bool g_bGuidOnly = false;
-int g_nGenerate = 0;
-bool g_bScan = false;
-std::vector<std::wstring> g_strScanFiles;
+// Looks up the file in the cache by the size and the time. Returns true if found
+static bool scan_cache_stamp(SCAN_CONTEXT *ctx, SCAN_WORKER& worker, GUID_FOUND& found,
+                             SCAN_FILE& file)
+{
+    file.stamped = get_file_stamp(*file.path, file.file.size, file.file.mtime);
+    if (!file.stamped)
+        return false;
 
+    auto it = ctx->cache.find(*file.path);
+    file.old = (it != ctx->cache.end()) ? &it->second : NULL;
+    if (!file.old || file.old->size != file.file.size || file.old->mtime != file.file.mtime)
+        return false;
 
-void show_version(void)
-{
-    std::puts(GUID_VERSION);
+    file.file.hash = file.old->hash;
+    file.file.found = file.old->found;
+    found.insert(found.end(), file.file.found.begin(), file.file.found.end());
+    worker.cache.emplace_back(*file.path, std::move(file.file));
+    return true;
 }
 
-void usage(void)
+static void scan_memory(SCAN_CONTEXT *ctx, GUID_FOUND& found, const void *ptr, size_t size)
 {
-    std::printf(
-        "rguid --- The GUID analyzer."
-        "\n"
-        "Usage:\n"
-        "  rguid --search \"STRING\"\n"
-        "  rguid IID_IDeskBand\n"
-        "  rguid \"{EB0FE172-1A3A-11D0-89B3-00A0C90A90AC}\"\n"
-        "  rguid \"72 E1 0F EB 3A 1A D0 11 89 B3 00 A0 C9 0A 90 AC\"\n"
-        "  rguid \"{ 0xEB0FE172, 0x1A3A, 0x11D0, { 0x89, 0xB3, 0x00, 0xA0, 0xC9, 0x0A,\n"
-        "            0x90, 0xAC } }\"\n"
-        "  rguid \"DEFINE_GUID(IID_IDeskBand, 0xEB0FE172, 0x1A3A, 0x11D0, 0x89, 0xB3,\n"
-        "                      0x00, 0xA0, 0xC9, 0x0A, 0x90, 0xAC);\"\n"
-        "  rguid --list\n"
-        "  rguid --generate NUMBER\n"
-        "  rguid --scan \"YOUR_FILE_1\" \"YOUR_FILE_2\" ...\n"
-        "  rguid --help\n"
-        "  rguid --version\n"
-        "\n"
-        "You can specify multiple GUIDs.\n");
+    if (g_bScanBinary)
+        g_database.scan_binary(found, ptr, size, ctx->threads);
+    else
+        guid_scan_memory(found, ptr, size, ctx->threads);
 }
 
-typedef enum RET
+// Scans the file read, or else maps it. With --cache, the contents are scanned only if the
+// hash differs from the cache
+static void scan_contents(SCAN_CONTEXT *ctx, SCAN_WORKER& worker, GUID_FOUND& found,
+                          SCAN_FILE& file)
 {
-    RET_DONE = 0,
-    RET_FAILED = -1,
-    RET_SUCCESS = +1,
-} RET;
+    if (!file.stamped)
+    {
+        if (file.read)
+            scan_memory(ctx, found, file.data, file.size);
+        else
+            scan_file(found, *file.path, ctx->threads);
+        return;
+    }
 
-void do_unittest(void)
-{
-#ifndef NDEBUG
-    GUID guid = IID_IShellLinkW;
+    const void *ptr = file.data;
+    size_t size = file.size;
+    if (!file.read)
+    {
+        size = 0;
+        ptr = NULL;
+        if (file.file.size > 0 && !(ptr = map_file(*file.path, &size)))
+        {
+            scan_file(found, *file.path, ctx->threads);
+            return;
+        }
+    }
+
+    file.file.size = size;
+    file.file.hash = content_hash(ptr, size);
+    if (file.old && file.old->size == file.file.size && file.old->hash == file.file.hash)
+        file.file.found = file.old->found;
+    else
+        scan_memory(ctx, file.file.found, ptr, size);
+    if (!file.read)
+        guid_unmap_file(ptr, size);
 
-    assert(g_database.load(L"guid.dat"));
+    found.insert(found.end(), file.file.found.begin(), file.file.found.end());
+    worker.cache.emplace_back(*file.path, std::move(file.file));
+}
 
+// The files of a batch, each into its own list, as the scanners sort all of the list
+static void scan_batch(SCAN_CONTEXT *ctx, SCAN_WORKER& worker, SCAN_READER& reader,
+                       std::vector<SCAN_TASK>& batch, size_t& compacted)
+{
+    SCAN_FILE files[SCAN_BATCH];
+    size_t count = 0;
     GUID_FOUND found;
-    assert(g_database.search_by_name(found, L"IID_IShellLinkW"));
-    assert(found.size() >= 1);
-    assert(found[0].name == L"IID_IShellLinkW");
-    assert(guid_equal(found[0].guid, IID_IShellLinkW));
+    for (auto& task : batch)
+    {
+        SCAN_FILE& file = files[count];
+        file.path = &task.path;
+        file.data = NULL;
+        file.size = 0;
+        file.regular = task.listed;
+        file.read = file.stamped = false;
+        file.old = NULL;
+        found.clear();
+        if (g_strScanCache.size() && scan_cache_stamp(ctx, worker, found, file))
+        {
+            worker.found.insert(worker.found.end(), found.begin(), found.end());
+            continue;
+        }
+        file.file = SCAN_CACHE_FILE();
+        ++count;
+    }
 
-    found.clear();
-    assert(g_database.search_by_guid(found, guid));
-    assert(found.size() >= 1);
-    assert(found[0].name == L"IID_IShellLinkW");
-    assert(guid_equal(found[0].guid, IID_IShellLinkW));
+    reader.read(files, count);
 
-    auto define_guid = guid_to_definition(guid, NULL);
-    assert(define_guid ==
-        L"DEFINE_GUID(<Name>, 0x000214F9, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);");
-    assert(guid_is_definition(define_guid.c_str()));
+    for (size_t i = 0; i < count; ++i)
+    {
+        found.clear();
+        scan_contents(ctx, worker, found, files[i]);
+        worker.found.insert(worker.found.end(), found.begin(), found.end());
+    }
 
-    auto guid_text = guid_to_guid_text(guid);
-    assert(guid_text == L"{000214F9-0000-0000-C000-000000000046}");
-    assert(guid_is_guid_text(guid_text.c_str()));
+    if (worker.found.size() >= 2 * compacted + 4096)
+    {
+        guid_sort_and_unique(worker.found);
+        compacted = worker.found.size();
+    }
+}
 
-    auto hex_text = guid_to_hex_text(guid);
-    assert(hex_text == L"F9 14 02 00 00 00 00 00 C0 00 00 00 00 00 00 46");
-    assert(guid_is_hex_text(hex_text.c_str()));
+static void scan_push(SCAN_CONTEXT *ctx, SCAN_WORKER& worker, std::vector<SCAN_TASK>& tasks)
+{
+    if (tasks.empty())
+        return;
 
-    auto struct_text = guid_to_struct_text(guid);
-    assert(struct_text == L"{ 0x000214F9, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } }");
-    assert(guid_is_struct_text(struct_text.c_str()));
-#endif
+    ctx->pending += tasks.size();
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        for (auto& task : tasks)
+            worker.tasks.push_back(std::move(task));
+    }
+    ctx->queued += tasks.size();
+    tasks.clear();
+
+    // A worker waiting sees queued or is woken up
+    if (ctx->idle > 0)
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->cond.notify_all();
+    }
 }
 
-RET do_guid(REFGUID guid, std::wstring *pstrName = NULL)
+static bool scan_take(SCAN_CONTEXT *ctx, SCAN_WORKER& worker, SCAN_TASK& task, bool own)
 {
-    if (!g_bDefOnly && !g_bGuidOnly)
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+        return false;
+
+    if (own)
+    {
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+    }
+    else
     {
-        std::printf("\n--------------------\n");
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
     }
+    --ctx->queued;
+    return true;
+}
 
-    std::wstring name;
-    if (pstrName == NULL)
+// Takes more files from the back of the queue of the worker, for a batch
+static void scan_take_files(SCAN_CONTEXT *ctx, SCAN_WORKER& worker, std::vector<SCAN_TASK>& batch)
+{
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    while (batch.size() < SCAN_BATCH && worker.tasks.size() && !worker.tasks.back().dir)
     {
-        for (auto& entry : g_database.data())
+        batch.push_back(std::move(worker.tasks.back()));
+        worker.tasks.pop_back();
+        --ctx->queued;
+    }
+}
+
+static void scan_worker(SCAN_CONTEXT *ctx, int index)
+{
+    SCAN_WORKER& self = ctx->workers[index];
+    const int nWorkers = (int)ctx->workers.size();
+    SCAN_READER reader;
+    std::vector<SCAN_TASK> tasks, batch;
+    size_t compacted = 0;
+
+    for (;;)
+    {
+        SCAN_TASK task;
+        bool got = scan_take(ctx, self, task, true);
+        for (int i = 1; !got && i < nWorkers; ++i)
+            got = scan_take(ctx, ctx->workers[(index + i) % nWorkers], task, false);
+
+        if (!got)
         {
-            if (guid_equal(guid, entry.guid))
-            {
-                name = entry.name;
-                if (!g_bDefOnly && !g_bGuidOnly)
-                    std::printf("Name: %ls\n\n", name.c_str());
-            }
+            std::unique_lock<std::mutex> lock(ctx->mutex);
+            ++ctx->idle;
+            ctx->cond.wait(lock, [&] { return ctx->queued > 0 || ctx->pending == 0; });
+            --ctx->idle;
+            if (ctx->pending == 0)
+                break;
+            continue;
+        }
+
+        size_t done = 1;
+        if (task.dir)
+        {
+            // The files go after the directories, to the back for the batches
+            read_directory(tasks, task);
+            std::stable_partition(tasks.begin(), tasks.end(), [](const SCAN_TASK& task) {
+                return task.dir;
+            });
+            scan_push(ctx, self, tasks);
+        }
+        else
+        {
+            batch.clear();
+            batch.push_back(std::move(task));
+            scan_take_files(ctx, self, batch);
+            scan_batch(ctx, self, reader, batch, compacted);
+            done = batch.size();
+        }
+
+        if ((ctx->pending -= done) == 0)
+        {
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->cond.notify_all();
         }
     }
-    else
+}
+
+// Scans the files and the directories with the workers. The main thread reads stdin if "-"
+RET do_scan(void)
+{
+    int nThreads = g_nThreads ? g_nThreads : (int)std::thread::hardware_concurrency();
+    if (nThreads <= 0)
+        nThreads = 1;
+
+    SCAN_CONTEXT ctx(nThreads);
+    GUID_FOUND found;
+    uint64_t stamp = g_bScanBinary ? database_stamp() : 0;
+    if (g_strScanCache.size())
+        load_scan_cache(ctx.cache, g_strScanCache, stamp);
+    bool bStdin = false;
+    std::vector<SCAN_TASK> tasks;
+    int next = 0;
+    for (auto& file : g_strScanFiles)
     {
-        name = *pstrName;
+        if (file == "-")
+        {
+            bStdin = true;
+            continue;
+        }
+
+        // Dealt round-robin
+        SCAN_TASK task;
+        task.path = file;
+        task.root = file.size();
+        if (task.root && file.back() != '/' && file.back() != '\\')
+            ++task.root;
+        task.dir = is_directory(file);
+        task.listed = false;
+        tasks.push_back(task);
+        scan_push(&ctx, ctx.workers[next++ % nThreads], tasks);
     }
 
-    if (g_bGuidOnly)
+    // The threads split a single file, or else take a file each
+    int nWorkers = nThreads;
+    if (next == 1 && !bStdin && !ctx.workers[0].tasks.front().dir)
     {
-        auto str = guid_to_guid_text(guid);
-        std::printf("%ls\n", str.c_str());
+        ctx.threads = nThreads;
+        nWorkers = 1;
     }
-    else if (g_bDefOnly)
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nWorkers && ctx.pending > 0; ++i)
+        threads.emplace_back(scan_worker, &ctx, i);
+
+    if (bStdin)
     {
-        auto str = guid_to_definition(guid, name.empty() ? nullptr : name.c_str());
-        std::printf("%ls\n", str.c_str());
+        if (g_bScanBinary)
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            g_database.scan_binary_fp(found, stdin);
+        }
+        else
+        {
+            guid_scan_fp(found, stdin);
+        }
     }
-    else
+
+    for (auto& thread : threads)
+        thread.join();
+
+    for (auto& worker : ctx.workers)
+        found.insert(found.end(), worker.found.begin(), worker.found.end());
+
+    if (g_strScanCache.size() && !save_scan_cache(ctx.workers, g_strScanCache, stamp))
+        fprintf(stderr, "ERROR: Cannot write '%s'\n", g_strScanCache.c_str());
+
+    for (auto& entry : found)
     {
-        auto str = guid_dump(guid, name.empty() ? nullptr : name.c_str());
-        std::printf("%ls", str.c_str());
+        if (entry.name.empty())
+        {
+            GUID_FOUND found2;
+            if (g_database.search_by_guid(found2, entry.guid))
+            {
+                entry.name = found2[0].name;
+            }
+        }
     }
 
+    guid_sort_and_unique(found);
+
+    std::string line;
+    for (auto& entry : found)
+        print_definition(line, entry.guid, entry.name.c_str());
     return RET_SUCCESS;
 }
 
-RET do_arg(std::wstring str)
+RET do_arg(std::string str)
 {
     GUID guid;
     if (guid_parse(guid, str.c_str()))
@@ -161,14 +1859,14 @@ RET do_arg(std::wstring str)
     }
     else
     {
-        if (!g_bDefOnly && !g_bGuidOnly)
+        if (!is_brief())
             std::printf("Not found\n");
         return RET_FAILED;
     }
 
     if (found.size() > 1)
     {
-        if (!g_bDefOnly && !g_bGuidOnly)
+        if (!is_brief())
             std::printf("Found %d found.\n", (int)found.size());
     }
 
@@ -180,66 +1878,88 @@ RET do_arg(std::wstring str)
     return RET_SUCCESS;
 }
 
-RET parse_option(std::wstring str)
+RET parse_option(std::string str)
 {
-    if (str == L"--help")
+    if (str == "--help")
     {
         usage();
         return RET_DONE;
     }
 
-    if (str == L"--version")
+    if (str == "--version")
     {
         show_version();
         return RET_DONE;
     }
 
-    if (str == L"--list")
+    if (str == "--list")
     {
         g_bList = true;
         return RET_SUCCESS;
     }
 
-    if (str == L"--def-only")
+    if (str == "--def-only")
     {
         g_bDefOnly = true;
         return RET_SUCCESS;
     }
 
-    if (str == L"--guid-only")
+    if (str == "--guid-only")
     {
         g_bGuidOnly = true;
         return RET_SUCCESS;
     }
 
-    if (str == L"--search")
+    if (str == "--struct-only")
+    {
+        g_bStructOnly = true;
+        return RET_SUCCESS;
+    }
+
+    if (str == "--hex-only")
+    {
+        g_bHexOnly = true;
+        return RET_SUCCESS;
+    }
+
+    if (str == "--search")
     {
         g_bSearch = true;
         return RET_SUCCESS;
     }
 
-    fprintf(stderr, "Invalid option: %ls\n", str.c_str());
+    fprintf(stderr, "Invalid option: %s\n", str.c_str());
     return RET_FAILED;
 }
 
-bool is_ident(const wchar_t *param)
+bool is_ident(const char *param)
 {
     if (param[0] == 0)
         return false;
 
     for (size_t ich = 0; param[ich]; ++ich)
     {
-        wchar_t ch = param[ich];
-        if (ich == 0 && !iswalpha(ch) && ch != L'_')
+        uint8_t ch = param[ich];
+        if (ich == 0 && !isalpha(ch) && ch != '_')
             return false;
-        if (ich > 0 && !iswalnum(ch) && ch != L'_')
+        if (ich > 0 && !isalnum(ch) && ch != '_')
             return false;
     }
 
     return true;
 }
 
-RET parse_cmd_line(std::vector<std::wstring>& args, int argc, char **argv)
+// An argument in UTF-8
+static std::string utf8_from_arg(const char *arg)
+{
+#if defined(_WIN32) && !defined(_WON32)
+    return guid_ansi_from_wide(guid_wide_from_ansi(arg).c_str(), CP_UTF8);
+#else
+    return arg;
+#endif
+}
+
+RET parse_cmd_line(std::vector<std::string>& args, int argc, char **argv)
 {
     if (argc <= 1)
     {
@@ -247,16 +1967,26 @@ RET parse_cmd_line(std::vector<std::wstring>& args, int argc, char **argv)
         return RET_FAILED;
     }
 
-    std::wstring param;
+    std::string param;
+    int depth = 0; // of the brackets in param
+    bool bracket = false; // whether param has any bracket
 
     for (int iarg = 1; iarg < argc; ++iarg)
     {
-        std::wstring str = guid_wide_from_ansi(argv[iarg]);
+        std::string str = utf8_from_arg(argv[iarg]);
+
+        // After --scan, the arguments but the options are the files
+        if (g_bScan && (str[0] != '-' || str == "-"))
+        {
+            g_strScanFiles.push_back(str);
+            continue;
+        }
 
-        if (str[0] == L'-')
+        if (str[0] == '-')
         {
-            if (str == L"--generate")
+            if (str == "--generate" || str == "--generate-v7")
             {
+                g_bGenerateV7 = (str == "--generate-v7");
                 if (argc <= iarg + 1)
                     g_nGenerate = 1;
                 else
@@ -264,30 +1994,100 @@ RET parse_cmd_line(std::vector<std::wstring>& args, int argc, char **argv)
 
                 if (g_nGenerate <= 0)
                 {
-                    fprintf(stderr, "ERROR: Zero or negative value specified for '--generate'\n");
+                    fprintf(stderr, "ERROR: Zero or negative value specified for '%s'\n", str.c_str());
+                    return RET_FAILED;
+                }
+
+                ++iarg;
+                continue;
+            }
+
+            if (str == "--generate-v5" || str == "--generate-v3")
+            {
+                if (iarg + 1 >= argc)
+                {
+                    fprintf(stderr, "ERROR: %s needs parameter\n", str.c_str());
+                    return RET_FAILED;
+                }
+
+                g_nNameVersion = (str == "--generate-v5") ? 5 : 3;
+                g_strNamespace = utf8_from_arg(argv[++iarg]);
+                if (iarg + 1 < argc && (argv[iarg + 1][0] != '-' || strcmp(argv[iarg + 1], "-") == 0))
+                    g_strNamesFile = argv[++iarg];
+                continue;
+            }
+
+            if (str == "--threads")
+            {
+                if (iarg + 1 >= argc)
+                {
+                    fprintf(stderr, "ERROR: --threads needs parameter\n");
+                    return RET_FAILED;
+                }
+
+                // Zero means the number of the CPUs
+                g_nThreads = atoi(argv[++iarg]);
+                if (g_nThreads == 0)
+                    g_nThreads = (int)std::thread::hardware_concurrency();
+                if (g_nThreads <= 0 || g_nThreads > 1024)
+                {
+                    fprintf(stderr, "ERROR: Invalid value specified for '--threads'\n");
+                    return RET_FAILED;
+                }
+                continue;
+            }
+
+            if (str == "--compile")
+            {
+                if (iarg + 2 >= argc)
+                {
+                    fprintf(stderr, "ERROR: --compile needs two parameters\n");
                     return RET_FAILED;
                 }
 
+                g_bCompile = true;
+                g_strCompileFrom = argv[iarg + 1];
+                g_strCompileTo = argv[iarg + 2];
                 param.clear();
                 args.clear();
                 return RET_SUCCESS;
             }
 
-            if (str == L"--scan")
+            if (str == "--scan" || str == "--scan-binary")
             {
                 if (iarg + 1 >= argc)
                 {
-                    fprintf(stderr, "ERROR: --scan needs parameter\n");
+                    fprintf(stderr, "ERROR: %s needs parameter\n", str.c_str());
                     return RET_FAILED;
                 }
 
                 g_bScan = true;
-                ++iarg;
-                while (iarg < argc)
+                g_bScanBinary = (str == "--scan-binary");
+                continue;
+            }
+
+            if (str == "--cache")
+            {
+                if (iarg + 1 >= argc)
+                {
+                    fprintf(stderr, "ERROR: --cache needs parameter\n");
+                    return RET_FAILED;
+                }
+
+                g_strScanCache = utf8_from_arg(argv[++iarg]);
+                continue;
+            }
+
+            if (str == "--include" || str == "--exclude")
+            {
+                if (iarg + 1 >= argc)
                 {
-                    g_strScanFiles.push_back(guid_wide_from_ansi(argv[iarg]));
-                    ++iarg;
+                    fprintf(stderr, "ERROR: %s needs parameter\n", str.c_str());
+                    return RET_FAILED;
                 }
+
+                auto& globs = (str == "--include") ? g_strIncludes : g_strExcludes;
+                globs.push_back(utf8_from_arg(argv[++iarg]));
                 continue;
             }
 
@@ -303,22 +2103,29 @@ RET parse_cmd_line(std::vector<std::wstring>& args, int argc, char **argv)
         }
 
         if (param.size())
-            param += L' ';
+            param += ' ';
 
         param += str;
 
-        if (guid_is_guid_text(param.c_str()) || guid_is_struct_text(param.c_str()) ||
-            guid_is_definition(param.c_str()) || guid_is_hex_text(param.c_str()))
+        // A struct or a definition split into arguments is parsed when closed
+        for (char ch : str)
         {
-            args.push_back(param);
-            param.clear();
-            continue;
+            int delta = (ch == '{' || ch == '(') - (ch == '}' || ch == ')');
+            if (delta)
+                bracket = true;
+            depth = std::max(depth + delta, 0); // not below for a stray closing bracket
         }
+        if (depth > 0)
+            continue;
 
-        if (is_ident(param.c_str()) && param != L"DEFINE_GUID")
+        // Once closed, the brackets are an argument even if not parsed
+        GUID guid;
+        if (guid_parse(guid, param.c_str(), param.size()) ||
+            (is_ident(param.c_str()) && param != "DEFINE_GUID") || bracket)
         {
             args.push_back(param);
             param.clear();
+            bracket = false;
             continue;
         }
     }
@@ -335,14 +2142,37 @@ int main(int argc, char **argv)
     do_unittest();
 #endif
 
-    std::vector<std::wstring> args;
+    std::vector<std::string> args;
     RET ret = parse_cmd_line(args, argc, argv);
     if (ret == RET_DONE)
         return 0;
     if (ret == RET_FAILED)
         return -1;
 
-    if (!g_database.load(L"guid.dat") && !g_bList && g_nGenerate == 0)
+    if (g_bCompile)
+    {
+        if (!guid_compile_data_a(g_strCompileFrom.c_str(), g_strCompileTo.c_str()))
+        {
+            fprintf(stderr, "ERROR: Cannot compile '%s' to '%s'\n",
+                    g_strCompileFrom.c_str(), g_strCompileTo.c_str());
+            return -3;
+        }
+        return 0;
+    }
+
+    // The compiled database is preferred unless guid.dat has changed since it was compiled.
+    // Files override the built-in database
+    bool loaded = g_database.load("guid.bin");
+    if (loaded && g_database.is_stale("guid.dat"))
+    {
+        fprintf(stderr, "WARNING: 'guid.bin' is out of date. Use --compile again\n");
+        loaded = false;
+    }
+    if (!loaded && !g_database.load("guid.dat") &&
+#ifdef RGUID_EMBED_DATABASE
+        !g_database.load_embedded() &&
+#endif
+        !g_bList && g_nGenerate == 0 && g_nNameVersion == 0)
     {
         std::printf("ERROR: File 'guid.dat' is not loaded\n");
         return -2;
@@ -350,52 +2180,35 @@ int main(int argc, char **argv)
 
     if (g_bList)
     {
-        for (auto& entry : g_database.data())
+        // Straight from the database in the order of the source, as UTF-8
+        const GUID_DB& db = g_database.db();
+        std::string line;
+        for (uint32_t i = 0; i < db.count; ++i)
         {
-            auto define_guid = guid_to_definition(entry.guid, entry.name.c_str());
-            std::printf("%ls\n", define_guid.c_str());
+            const GUID_DB_RECORD& record = db.records[db.order[i]];
+            print_definition(line, record.guid, &db.names[record.name_offset]);
         }
         return 0;
     }
 
     if (g_bScan)
     {
-        GUID_FOUND found;
-        for (auto& file : g_strScanFiles)
-        {
-            guid_scan_file_w(found, file.c_str());
-        }
-
-        for (auto& entry : found)
-        {
-            if (entry.name.empty())
-            {
-                GUID_FOUND found2;
-                if (g_database.search_by_guid(found2, entry.guid))
-                {
-                    entry.name = found2[0].name;
-                }
-            }
-        }
-
-        guid_sort_and_unique(found);
+        if (do_scan() == RET_FAILED)
+            return -5;
+        return 0;
+    }
 
-        for (auto& entry : found)
-        {
-            auto define_guid = guid_to_definition(entry.guid, entry.name.c_str());
-            std::printf("%ls\n", define_guid.c_str());
-        }
+    if (g_nNameVersion)
+    {
+        if (do_generate_names() == RET_FAILED)
+            return -5;
         return 0;
     }
 
     if (g_nGenerate > 0)
     {
-        for (int i = 0; i < g_nGenerate; ++i)
-        {
-            GUID guid;
-            guid_random_generate(guid);
-            do_guid(guid);
-        }
+        if (do_generate(g_nGenerate) == RET_FAILED)
+            return -5;
         return 0;
     }
 